@@ -45,6 +45,8 @@ void setup()
   // if the file is available, seek to last position
   if (dataFile) {
     dataFile.seek(dataFile.size());
+    // sync the file from SD.idle() when data is 1 s old or 4 KB are pending
+    dataFile.setFlushPolicy(1000, 4096);
   }
   // if the file isn't open, pop up an error:
   else {
@@ -70,7 +72,6 @@ void loop()
   // if the file is available, write to it:
   if (dataFile) {
     dataFile.println(dataString);
-    dataFile.flush(); // use flush to ensure the data written
     // print to the serial port too:
     Serial.println(dataString);
   }
@@ -78,5 +79,7 @@ void loop()
   else {
     Serial.println("error on datalog.txt file handle");
   }
+  // sync the data written according to the flush policy
+  SD.idle();
   delay(100);
 }
@@ -0,0 +1,88 @@
+/**
+  ******************************************************************************
+  * @file    bench_sd.cpp
+  * @brief   Sequential write/read benchmark of the library over the emulated
+  *          card. Prints the modelled throughput and the card commands for
+  *          several chunk sizes.
+  *          Usage: bench_sd [image size in MB] [file size in KB]
+  ******************************************************************************
+  */
+#include <Arduino.h>
+#include <STM32SD.h>
+#include <inttypes.h>
+#include <vector>
+
+/* Class 10 like card: 2ms per command, 25MB/s reads, 10MB/s writes */
+static const BSP_SD_HostTiming timing = { 2000, 20, 50, 250, 1, 0 };
+
+static bool run(const char *name, size_t chunk, uint32_t fileSize, uint8_t *data)
+{
+  BSP_SD_HostStats stats;
+  File file;
+
+  BSP_SD_HostResetStats();
+  file = SD.open(name, FILE_WRITE);
+  if (!file) {
+    printf("open %s failed\n", name);
+    return false;
+  }
+  for (uint32_t done = 0; done < fileSize; done += chunk) {
+    for (size_t i = 0; i < chunk; i++) {
+      data[i] = (uint8_t)(done + i);
+    }
+    if (file.write(data, chunk) != chunk) {
+      printf("write %s failed\n", name);
+      return false;
+    }
+  }
+  file.close();
+  BSP_SD_HostGetStats(&stats);
+  printf("%6zu B chunks: write %8.2f KB/s (%" PRIu32 " cmds, %" PRIu64 " blocks)",
+         chunk, (fileSize / 1024.0) / (stats.ElapsedUs / 1e6), stats.WriteCmds, stats.BlocksWritten);
+
+  BSP_SD_HostResetStats();
+  file = SD.open(name, FILE_READ);
+  if (!file) {
+    printf("\nopen %s failed\n", name);
+    return false;
+  }
+  for (uint32_t done = 0; done < fileSize; done += chunk) {
+    if (file.read(data, chunk) != (int)chunk) {
+      printf("\nread %s failed\n", name);
+      return false;
+    }
+    for (size_t i = 0; i < chunk; i++) {
+      if (data[i] != (uint8_t)(done + i)) {
+        printf("\n%s: wrong data at %" PRIu32 "\n", name, done + (uint32_t)i);
+        return false;
+      }
+    }
+  }
+  file.close();
+  BSP_SD_HostGetStats(&stats);
+  printf(", read %8.2f KB/s (%" PRIu32 " cmds, %" PRIu64 " blocks)\n",
+         (fileSize / 1024.0) / (stats.ElapsedUs / 1e6), stats.ReadCmds, stats.BlocksRead);
+  return SD.remove(name);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t imageMB = (argc > 1) ? strtoul(argv[1], NULL, 0) : 64;
+  uint32_t fileKB = (argc > 2) ? strtoul(argv[2], NULL, 0) : 4096;
+  static const size_t chunks[] = { 512, 4096, 32768 };
+  std::vector<uint8_t> image((size_t)imageMB * 1024 * 1024);
+  std::vector<uint8_t> data(32768);
+  bool ok = true;
+
+  BSP_SD_HostAttachRam(image.data(), image.size() / SD_HOST_BLOCK_SIZE);
+  if (!SD.begin() && !SD.format()) {
+    printf("format failed\n");
+    return 1;
+  }
+  BSP_SD_HostSetTiming(&timing);
+  printf("%" PRIu32 " KB file on a %" PRIu32 " MB card\n", fileKB, imageMB);
+  for (size_t chunk : chunks) {
+    ok = run("bench.bin", chunk, fileKB * 1024, data.data()) && ok;
+  }
+  return ok ? 0 : 1;
+}
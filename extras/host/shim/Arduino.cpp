@@ -0,0 +1,70 @@
+/**
+  ******************************************************************************
+  * @file    Arduino.cpp
+  * @brief   Host implementation of the minimal Arduino core API and of the
+  *          FatFs functions provided by the application or the core on target.
+  ******************************************************************************
+  */
+#define _POSIX_C_SOURCE 200809L
+#include "Arduino.h"
+#include "FatFs.h"
+#include <time.h>
+#include <sched.h>
+
+HardwareSerial Serial;
+
+static uint64_t host_clock_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000U) + (ts.tv_nsec / 1000);
+}
+
+uint32_t millis(void)
+{
+  return (uint32_t)(host_clock_us() / 1000);
+}
+
+uint32_t micros(void)
+{
+  return (uint32_t)host_clock_us();
+}
+
+void delay(uint32_t ms)
+{
+  struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+  nanosleep(&ts, NULL);
+}
+
+void yield(void)
+{
+  sched_yield();
+}
+
+void Error_Handler(void)
+{
+  fprintf(stderr, "Error_Handler\n");
+  abort();
+}
+
+extern "C" {
+
+__attribute__((weak)) DWORD get_fattime(void)
+{
+  /* 2024/01/01 00:00:00 */
+  return ((DWORD)(2024 - 1980) << 25) | ((DWORD)1 << 21) | ((DWORD)1 << 16);
+}
+
+#if _USE_LFN == 3
+__attribute__((weak)) void *ff_memalloc(UINT msize)
+{
+  return malloc(msize);
+}
+
+__attribute__((weak)) void ff_memfree(void *mblock)
+{
+  free(mblock);
+}
+#endif
+
+}
@@ -0,0 +1,158 @@
+/**
+  ******************************************************************************
+  * @file    Arduino.h
+  * @brief   Minimal Arduino core API used by the library, to build it on a
+  *          host (PC) with SD_HOST_EMULATION. Not used on target.
+  ******************************************************************************
+  */
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(uint32_t ms);
+void yield(void);
+void Error_Handler(void);
+
+#ifdef __cplusplus
+}
+
+class String {
+  public:
+    String(const char *str = "") : _str(str) {}
+    const char *c_str() const
+    {
+      return _str;
+    }
+  private:
+    const char *_str;
+};
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+      size_t n = 0;
+      while (size--) {
+        n += write(*buffer++);
+      }
+      return n;
+    }
+    virtual size_t write(const char *buffer, size_t size)
+    {
+      return write((const uint8_t *)buffer, size);
+    }
+    size_t write(const char *str)
+    {
+      return (str == NULL) ? 0 : write((const uint8_t *)str, strlen(str));
+    }
+    size_t print(const char *str)
+    {
+      return write(str);
+    }
+    size_t print(char c)
+    {
+      return write((uint8_t)c);
+    }
+    size_t print(unsigned long long n, int base = 10)
+    {
+      char buf[24];
+      snprintf(buf, sizeof(buf), (base == 16) ? "%llx" : "%llu", n);
+      return write(buf);
+    }
+    size_t print(long long n, int base = 10)
+    {
+      if ((n < 0) && (base == 10)) {
+        return print('-') + print((unsigned long long)(-n), base);
+      }
+      return print((unsigned long long)n, base);
+    }
+    size_t print(unsigned long n, int base = 10)
+    {
+      return print((unsigned long long)n, base);
+    }
+    size_t print(long n, int base = 10)
+    {
+      return print((long long)n, base);
+    }
+    size_t print(unsigned int n, int base = 10)
+    {
+      return print((unsigned long long)n, base);
+    }
+    size_t print(int n, int base = 10)
+    {
+      return print((long long)n, base);
+    }
+    size_t println(void)
+    {
+      return write("\r\n");
+    }
+    template <typename T> size_t println(T value)
+    {
+      return print(value) + println();
+    }
+    template <typename T> size_t println(T value, int base)
+    {
+      return print(value, base) + println();
+    }
+    virtual void flush() {}
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+/* Serial writes to stdout */
+class HardwareSerial : public Stream {
+  public:
+    void begin(uint32_t baud)
+    {
+      (void)baud;
+    }
+    size_t write(uint8_t c)
+    {
+      return (putchar(c) == EOF) ? 0 : 1;
+    }
+    using Print::write;
+    int available()
+    {
+      return 0;
+    }
+    int read()
+    {
+      return -1;
+    }
+    int peek()
+    {
+      return -1;
+    }
+    void flush()
+    {
+      fflush(stdout);
+    }
+    operator bool()
+    {
+      return true;
+    }
+};
+
+extern HardwareSerial Serial;
+
+#endif /* __cplusplus */
+
+#endif /* ARDUINO_H */
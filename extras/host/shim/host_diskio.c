@@ -0,0 +1,93 @@
+/**
+  ******************************************************************************
+  * @file    host_diskio.c
+  * @brief   SD_Driver disk I/O driver over the BSP, as drivers/sd_diskio.c of
+  *          the FatFs library does on target, for the host build.
+  ******************************************************************************
+  */
+#include "FatFs.h"
+#include "bsp_sd.h"
+
+#define SD_TRANSFER_OK          ((uint8_t)0x00)
+#define SD_DEFAULT_BLOCK_SIZE   512
+
+static volatile DSTATUS Stat = STA_NOINIT;
+
+static DSTATUS SD_initialize(BYTE lun)
+{
+  (void)lun;
+  Stat = (BSP_SD_Init() == MSD_OK) ? 0 : STA_NOINIT;
+  return Stat;
+}
+
+static DSTATUS SD_status(BYTE lun)
+{
+  (void)lun;
+  return Stat;
+}
+
+static DRESULT SD_wait(void)
+{
+  uint32_t polls = 0;
+
+  while (BSP_SD_GetCardState() != SD_TRANSFER_OK) {
+    if (++polls == 0) {
+      return RES_ERROR;
+    }
+  }
+  return RES_OK;
+}
+
+static DRESULT SD_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+  (void)lun;
+  if (BSP_SD_ReadBlocks((uint32_t *)buff, sector, count, SD_DATATIMEOUT) != MSD_OK) {
+    return RES_ERROR;
+  }
+  return SD_wait();
+}
+
+static DRESULT SD_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+  (void)lun;
+  if (BSP_SD_WriteBlocks((uint32_t *)buff, sector, count, SD_DATATIMEOUT) != MSD_OK) {
+    return RES_ERROR;
+  }
+  return SD_wait();
+}
+
+static DRESULT SD_ioctl(BYTE lun, BYTE cmd, void *buff)
+{
+  HAL_SD_CardInfoTypeDef CardInfo;
+
+  (void)lun;
+  if (Stat & STA_NOINIT) {
+    return RES_NOTRDY;
+  }
+  switch (cmd) {
+    case CTRL_SYNC:
+      return RES_OK;
+    case GET_SECTOR_COUNT:
+      BSP_SD_GetCardInfo(&CardInfo);
+      *(DWORD *)buff = CardInfo.LogBlockNbr;
+      return RES_OK;
+    case GET_SECTOR_SIZE:
+      BSP_SD_GetCardInfo(&CardInfo);
+      *(WORD *)buff = CardInfo.LogBlockSize;
+      return RES_OK;
+    case GET_BLOCK_SIZE:
+      BSP_SD_GetCardInfo(&CardInfo);
+      *(DWORD *)buff = CardInfo.LogBlockSize / SD_DEFAULT_BLOCK_SIZE;
+      return RES_OK;
+    default:
+      return RES_PARERR;
+  }
+}
+
+const Diskio_drvTypeDef SD_Driver = {
+  SD_initialize,
+  SD_status,
+  SD_read,
+  SD_write,
+  SD_ioctl,
+};
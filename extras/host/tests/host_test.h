@@ -0,0 +1,41 @@
+/**
+  ******************************************************************************
+  * @file    host_test.h
+  * @brief   Helpers of the host tests: emulated card and checks.
+  ******************************************************************************
+  */
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <Arduino.h>
+#include <STM32SD.h>
+#include <inttypes.h>
+#include <vector>
+
+static int test_failures = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      test_failures++; \
+    } \
+  } while (0)
+
+/* Attach a blank RAM image of sizeMB to the emulated card and format it */
+static inline bool test_mount(std::vector<uint8_t> &image, uint32_t sizeMB)
+{
+  image.assign((size_t)sizeMB * 1024 * 1024, 0);
+  if (BSP_SD_HostAttachRam(image.data(), image.size() / SD_HOST_BLOCK_SIZE) != MSD_OK) {
+    return false;
+  }
+  return SD.begin() || SD.format();
+}
+
+static inline int test_result(const char *name)
+{
+  printf("%s: %s\n", name, (test_failures == 0) ? "OK" : "FAILED");
+  return (test_failures == 0) ? 0 : 1;
+}
+
+#endif /* HOST_TEST_H */
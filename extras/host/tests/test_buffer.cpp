@@ -0,0 +1,94 @@
+/**
+  ******************************************************************************
+  * @file    test_buffer.cpp
+  * @brief   Write buffer test on a full volume: the data accepted by write()
+  *          and not written by FatFs stays in the buffer, the error is kept
+  *          in the error state, and the data is written once room is made.
+  *          fgets() after reads served by a read buffer.
+  ******************************************************************************
+  */
+#include "host_test.h"
+
+#define CHUNK_LEN 100
+
+static uint8_t pattern(uint32_t pos)
+{
+  return (uint8_t)(pos + (pos >> 8) + 17);
+}
+
+int main(void)
+{
+  std::vector<uint8_t> image;
+  static uint8_t data[4096];
+  uint32_t accepted = 0;
+
+  CHECK(test_mount(image, 4));
+
+  // Fill the volume
+  File filler = SD.open("/filler.bin", FILE_WRITE);
+  CHECK(filler);
+  while (filler.write(data, sizeof(data)) == sizeof(data)) {
+  }
+  filler.close();
+
+  File file = SD.open("/log.bin", FILE_WRITE);
+  CHECK(file);
+  CHECK(file.setBuffer(nullptr, SD_FILE_BUFFER_SIZE, BUF_WRITE));
+  CHECK(file.getErrorstate() == FR_OK);
+  // Accepted until the buffer is full of data which cannot be written
+  for (int i = 0; i < 20; i++) {
+    uint8_t chunk[CHUNK_LEN];
+    for (uint32_t j = 0; j < CHUNK_LEN; j++) {
+      chunk[j] = pattern(accepted + j);
+    }
+    // The bytes not accepted are written again by the caller
+    accepted += file.write(chunk, CHUNK_LEN);
+  }
+  printf("accepted %" PRIu32 " bytes on a full volume\n", accepted);
+  CHECK(accepted == SD_FILE_BUFFER_SIZE);
+  CHECK(file.getErrorstate() != FR_OK);
+  file.flush();
+  // The buffered data still counts in the file size
+  CHECK(file.size() == accepted);
+  // Kept while the data cannot be written
+  CHECK(!file.setBuffer(nullptr, 0));
+
+  // Room made: the data kept is written
+  CHECK(SD.remove("/filler.bin"));
+  file.flush();
+  CHECK(file.size() == accepted);
+  CHECK(file.setBuffer(nullptr, 0));
+  file.close();
+
+  file = SD.open("/log.bin", FILE_READ);
+  CHECK(file && (file.size() == accepted));
+  for (uint32_t pos = 0; pos < accepted; pos++) {
+    int c = file.read();
+    if (c != pattern(pos)) {
+      CHECK(c == pattern(pos));
+      break;
+    }
+  }
+  file.close();
+
+  // fgets() goes on from the position of the buffered reads
+  file = SD.open("/lines.txt", FILE_WRITE);
+  CHECK(file);
+  file.print("first line\nsecond line\nthird\n");
+  file.close();
+  file = SD.open("/lines.txt", FILE_READ);
+  CHECK(file && file.setBuffer());
+  TCHAR line[32];
+  CHECK(file.read() == 'f');
+  CHECK(file.fgets(line, sizeof(line)) == 10);
+  CHECK(strcmp(line, "irst line\n") == 0);
+  CHECK(file.read() == 's');
+  CHECK(file.fgets(line, 5) == 4);
+  CHECK(strcmp(line, "econ") == 0);
+  CHECK(file.fgets(line, sizeof(line)) == 7);
+  CHECK(file.fgets(line, sizeof(line)) == 6);
+  CHECK(strcmp(line, "third\n") == 0);
+  CHECK(file.fgets(line, sizeof(line)) == -1);
+  file.close();
+  return test_result("test_buffer");
+}
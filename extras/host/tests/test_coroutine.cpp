@@ -0,0 +1,119 @@
+/**
+  ******************************************************************************
+  * @file    test_coroutine.cpp
+  * @brief   SdTask test: three tasks write then read back their own file
+  *          through SdCoFile, resumed by SD.service(). Checks the file
+  *          contents, that the requests of the tasks are served in turn, and
+  *          close() run by await_resume() from the completion callback.
+  ******************************************************************************
+  */
+#include "host_test.h"
+#include <SdCoroutine.h>
+#include <string>
+
+#ifndef SD_COROUTINE
+#error "test_coroutine needs a C++20 compiler"
+#endif
+
+#define TASKS      3
+#define CHUNK_LEN  300  // not a multiple of SD_ASYNC_SLICE: several slices per request
+
+static std::string order;    // one letter per completed write or read, 'A' for task 0
+static bool serving = false; // true while main() runs SD.service()
+
+static uint8_t pattern(int id, uint32_t pos)
+{
+  return (uint8_t)((id * 53) + pos + (pos >> 8));
+}
+
+static SdTask worker(int id, int chunks)
+{
+  char path[16];
+  uint8_t data[CHUNK_LEN];
+  SdCoFile co;
+
+  snprintf(path, sizeof(path), "/co%d.bin", id);
+  CHECK(co_await co.open(path, FILE_WRITE));
+  for (int c = 0; c < chunks; c++) {
+    for (uint32_t i = 0; i < CHUNK_LEN; i++) {
+      data[i] = pattern(id, c * CHUNK_LEN + i);
+    }
+    CHECK(co_await co.write(data, CHUNK_LEN) == CHUNK_LEN);
+    order += (char)('A' + id);
+  }
+  CHECK(co_await co.sync() == 0);
+  CHECK(co.file.size() == (uint32_t)(chunks * CHUNK_LEN));
+  // Resumed by completeAsync(), from SD.service(): close() runs there
+  CHECK(co_await co.close() == 0);
+  CHECK(serving);
+  CHECK(!co.file);
+
+  CHECK(co_await co.open(path, FILE_READ));
+  for (int c = 0; c < chunks; c++) {
+    CHECK(co_await co.read(data, CHUNK_LEN) == CHUNK_LEN);
+    order += (char)('a' + id);
+    for (uint32_t i = 0; i < CHUNK_LEN; i++) {
+      if (data[i] != pattern(id, c * CHUNK_LEN + i)) {
+        CHECK(data[i] == pattern(id, c * CHUNK_LEN + i));
+        break;
+      }
+    }
+  }
+  // End of file: an empty read
+  CHECK(co_await co.read(data, CHUNK_LEN) == 0);
+  CHECK(co_await co.close() == 0);
+  CHECK(!co.file);
+}
+
+/* Each task queues its next request from the completion of the previous
+   one: with as many chunks for every task, the tasks take turns in queue
+   order, for the writes then for the reads */
+static std::string expected(int chunks)
+{
+  std::string writes, reads;
+
+  for (int c = 0; c < chunks; c++) {
+    for (int id = 0; id < TASKS; id++) {
+      writes += (char)('A' + id);
+      reads += (char)('a' + id);
+    }
+  }
+  return writes + reads;
+}
+
+int main(void)
+{
+  std::vector<uint8_t> image;
+  const int chunks = 6;
+
+  CHECK(test_mount(image, 16));
+  {
+    SdTask tasks[TASKS] = { worker(0, chunks), worker(1, chunks), worker(2, chunks) };
+    int loops = 0;
+
+    // Each task is suspended on its first write
+    for (int id = 0; id < TASKS; id++) {
+      CHECK(!tasks[id].done());
+    }
+    serving = true;
+    while (SD.service() && (loops++ < 100000)) {
+    }
+    serving = false;
+    for (int id = 0; id < TASKS; id++) {
+      CHECK(tasks[id].done());
+    }
+    printf("order: %s\n", order.c_str());
+    CHECK(order == expected(chunks));
+  }
+
+  // The files are closed and their pool entries free
+  for (int id = 0; id < TASKS; id++) {
+    char path[16];
+    snprintf(path, sizeof(path), "/co%d.bin", id);
+    File file = SD.open(path, FILE_READ);
+    CHECK(file && (file.size() == (uint32_t)(chunks * CHUNK_LEN)));
+    file.close();
+  }
+  CHECK(SD.poolExhausted() == 0);
+  return test_result("test_coroutine");
+}
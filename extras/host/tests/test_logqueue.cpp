@@ -0,0 +1,110 @@
+/**
+  ******************************************************************************
+  * @file    test_logqueue.cpp
+  * @brief   SdLogQueue: drain() on sector boundaries from aligned and
+  *          unaligned file positions, overflows and file contents.
+  ******************************************************************************
+  */
+#include "host_test.h"
+#include <SdLogQueue.h>
+
+static SdLogQueue<2048> queue;
+
+/* Record i: 20 bytes "rec:<5 digits>......\n" */
+static void record(uint32_t i, char *rec)
+{
+  snprintf(rec, 21, "rec:%05" PRIu32 "......", i);
+  rec[19] = '\n';
+}
+
+static void test_unaligned(void)
+{
+  char rec[21];
+  uint32_t count = 0;
+  File file = SD.open("log.txt", FILE_WRITE);
+
+  CHECK(file);
+  // Unaligned start: 500 bytes already in the file
+  for (int i = 0; i < 25; i++) {
+    record(count++, rec);
+    CHECK(file.write((const uint8_t *)rec, 20) == 20);
+  }
+  CHECK(file.position() == 500);
+
+  // 10 bytes queued do not reach the next sector boundary: nothing written
+  record(count, rec);
+  CHECK(queue.push(rec, 10));
+  CHECK(queue.drain(file) == 0);
+  CHECK(file.position() == 500);
+  CHECK(queue.available() == 10);
+  CHECK(queue.push(rec + 10, 10));
+  count++;
+
+  // 20 bytes reach the boundary at 512: 12 bytes written
+  CHECK(queue.drain(file) == 12);
+  CHECK(file.position() == 512);
+  CHECK(queue.available() == 8);
+
+  // Fill the queue: the drain stops on the last boundary
+  while (queue.available() + 20 <= 2048) {
+    record(count++, rec);
+    CHECK(queue.pushShared(rec, 20));
+  }
+  record(count, rec);
+  CHECK(!queue.push(rec, 20));
+  size_t queued = queue.available();
+  size_t done = queue.drain(file);
+  CHECK(done == ((512 + queued) & ~(size_t)511) - 512);
+  CHECK((file.position() % 512) == 0);
+  CHECK(queue.available() == queued - done);
+
+  // Flush the remaining records
+  CHECK(queue.drain(file, true) == queued - done);
+  CHECK(queue.available() == 0);
+  file.close();
+
+  SdLogQueueStats stats;
+  queue.getStats(&stats, true);
+  CHECK(stats.overflows == 1);
+  CHECK(stats.dropped == 20);
+  CHECK(stats.highWater == queued);
+
+  // Contents: all records in order
+  file = SD.open("log.txt", FILE_READ);
+  CHECK(file);
+  CHECK(file.size() == count * 20);
+  for (uint32_t i = 0; i < count; i++) {
+    char expected[21];
+    record(i, expected);
+    CHECK(file.read(rec, 20) == 20);
+    CHECK(memcmp(rec, expected, 20) == 0);
+  }
+  file.close();
+}
+
+static void test_aligned(void)
+{
+  uint8_t data[300];
+  File file = SD.open("aligned.bin", FILE_WRITE);
+
+  CHECK(file);
+  memset(data, 0xA5, sizeof(data));
+  // 600 bytes from position 0: one sector written, 88 bytes kept
+  CHECK(queue.push(data, sizeof(data)));
+  CHECK(queue.push(data, sizeof(data)));
+  CHECK(queue.drain(file) == 512);
+  CHECK(queue.available() == 88);
+  CHECK(queue.drain(file, true) == 88);
+  CHECK(file.size() == 600);
+  file.close();
+}
+
+int main(void)
+{
+  std::vector<uint8_t> image;
+
+  CHECK(test_mount(image, 16));
+  test_unaligned();
+  test_aligned();
+  return test_result("test_logqueue");
+}
@@ -0,0 +1,71 @@
+/**
+  ******************************************************************************
+  * @file    test_ls.cpp
+  * @brief   File::ls() CSV and JSON test: the relative paths are written in
+  *          full, also when longer than SD_LS_PATH_MAX. File::openNextFile()
+  *          opens the entries by their full path.
+  ******************************************************************************
+  */
+#include "host_test.h"
+#include <string>
+
+/* Print collecting the output */
+class StringPrint : public Print {
+  public:
+    size_t write(uint8_t c)
+    {
+      text += (char)c;
+      return 1;
+    }
+    std::string text;
+};
+
+int main(void)
+{
+  std::vector<uint8_t> image;
+  std::string a(60, 'a');
+  std::string b(60, 'b');
+  std::string name = std::string(40, 'c') + ".txt";
+  std::string rel = a + "/" + b + "/" + name;
+
+  CHECK(test_mount(image, 16));
+  CHECK(rel.size() >= SD_LS_PATH_MAX);
+  CHECK(SD.mkdir("/ls"));
+  CHECK(SD.mkdir(("/ls/" + a).c_str()));
+  CHECK(SD.mkdir(("/ls/" + a + "/" + b).c_str()));
+  File file = SD.open(("/ls/" + rel).c_str(), FILE_WRITE);
+  CHECK(file);
+  file.print("hello");
+  file.close();
+
+  File dir = SD.open("/ls");
+  CHECK(dir);
+  StringPrint csv;
+  dir.ls(LS_R | LS_CSV, 0, &csv);
+  CHECK(csv.text.find("\"" + rel + "\",F,5,") != std::string::npos);
+  CHECK(csv.text.find("\"" + a + "/" + b + "\",D,") != std::string::npos);
+  dir.close();
+
+  dir = SD.open("/ls");
+  StringPrint json;
+  dir.ls(LS_R | LS_JSON, 0, &json);
+  CHECK(json.text.find("{\"path\":\"" + rel + "\",\"dir\":false,\"size\":5,") != std::string::npos);
+  dir.close();
+
+  // "/ls/" + a, then the file in a/b, with or without a trailing '/'
+  dir = SD.open("/ls");
+  File next = dir.openNextFile();
+  CHECK(next && next.isDirectory() && (std::string(next.fullname()) == "/ls/" + a));
+  next.close();
+  dir.close();
+  dir = SD.open(("/ls/" + a + "/" + b + "/").c_str());
+  next = dir.openNextFile();
+  CHECK(next && !next.isDirectory() && (next.size() == 5));
+  CHECK(next && (std::string(next.fullname()) == "/ls/" + rel));
+  next.close();
+  dir.close();
+  if (test_failures != 0) {
+    printf("%s%s", csv.text.c_str(), json.text.c_str());
+  }
+  return test_result("test_ls");
+}
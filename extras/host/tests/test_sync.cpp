@@ -0,0 +1,209 @@
+/**
+  ******************************************************************************
+  * @file    test_sync.cpp
+  * @brief   SD_FS_REENTRANT stress test: 1 to 8 threads create, write, read
+  *          back, rename and remove files in their own and shared
+  *          directories, through the path lookup cache, the static pools,
+  *          the File buffers, fast seek tables, flush policies and the
+  *          asynchronous queue, while another thread runs SD.idle() and
+  *          lists the card. Prints the throughput for each thread count.
+  ******************************************************************************
+  */
+#include "host_test.h"
+#include <SdDirIterator.h>
+#include <pthread.h>
+#include <atomic>
+
+#define FILE_LEN   3000
+#define ASYNC_LEN  1024
+#define ITERATIONS 200
+
+static std::atomic<bool> stop;
+static std::atomic<uint32_t> files;
+static pthread_mutex_t report = PTHREAD_MUTEX_INITIALIZER;
+
+#define TCHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      pthread_mutex_lock(&report); \
+      printf("%s:%d: check failed: %s (thread %d, iteration %d)\n", __FILE__, __LINE__, #cond, id, iter); \
+      test_failures++; \
+      pthread_mutex_unlock(&report); \
+    } \
+  } while (0)
+
+static uint8_t pattern(int id, int iter, uint32_t pos)
+{
+  return (uint8_t)((id * 31) + (iter * 7) + pos + (pos >> 8));
+}
+
+static void *worker(void *arg)
+{
+  int id = (int)(intptr_t)arg;
+  int iter = 0;
+  char dir[32];
+  char path[48];
+  char moved[48];
+  uint8_t data[ASYNC_LEN];
+
+  snprintf(dir, sizeof(dir), "/t%d", id);
+  TCHECK(SD.mkdir(dir));
+  for (iter = 0; iter < ITERATIONS; iter++) {
+    // Own directories and a directory shared by all threads
+    if ((iter % 3) == 2) {
+      snprintf(path, sizeof(path), "/shared/f%d_%d.bin", id, iter % 2);
+    } else {
+      snprintf(path, sizeof(path), "/t%d/s%d/f%d.bin", id, iter % 2, iter % 3);
+      snprintf(dir, sizeof(dir), "/t%d/s%d", id, iter % 2);
+      TCHECK(SD.mkdir(dir));
+    }
+    SD.remove(path);
+    TCHECK(!SD.exists(path));
+
+    File file = SD.open(path, FILE_WRITE);
+    TCHECK(file);
+    if (!file) {
+      continue;
+    }
+    // Pools smaller than the number of threads: may fail, never shared
+    bool buffered = file.setBuffer(nullptr, SD_FILE_BUFFER_SIZE, BUF_WRITE);
+    file.setFlushPolicy(2, 1024);
+    for (uint32_t pos = 0; pos < FILE_LEN;) {
+      size_t n = 100 + ((pos / 100) % 7) * 13;
+      if (n > FILE_LEN - pos) {
+        n = FILE_LEN - pos;
+      }
+      for (size_t i = 0; i < n; i++) {
+        data[i] = pattern(id, iter, pos + i);
+      }
+      TCHECK(file.write(data, n) == n);
+      pos += n;
+    }
+    uint32_t len = FILE_LEN;
+    if ((iter % 4) == 0) {
+      // Served by whichever thread calls SD.service()
+      SdAsyncRequest req;
+      for (uint32_t i = 0; i < ASYNC_LEN; i++) {
+        data[i] = pattern(id, iter, FILE_LEN + i);
+      }
+      TCHECK(file.writeAsync(req, data, ASYNC_LEN));
+      while (req.pending) {
+        SD.service();
+      }
+      TCHECK(!req.error && (req.done == ASYNC_LEN));
+      len += ASYNC_LEN;
+    }
+    if (buffered) {
+      TCHECK(file.setBuffer(nullptr, 0));
+    }
+    file.close();
+
+    // Read back, with a fast seek table if one is free
+    file = SD.open(path, FILE_READ);
+    TCHECK(file);
+    if (!file) {
+      continue;
+    }
+    TCHECK(file.size() == len);
+    file.enableFastSeek();
+    file.setBuffer();
+    TCHECK(file.seek(len / 2));
+    for (uint32_t pos = len / 2; pos < len;) {
+      int n = file.read(data, sizeof(data));
+      TCHECK(n > 0);
+      if (n <= 0) {
+        break;
+      }
+      for (int i = 0; i < n; i++, pos++) {
+        if (data[i] != pattern(id, iter, pos)) {
+          TCHECK(data[i] == pattern(id, iter, pos));
+          pos = len;
+          break;
+        }
+      }
+    }
+    file.close();
+
+    // Rename in the same directory, then remove
+    if ((iter % 2) == 1) {
+      snprintf(moved, sizeof(moved), "%s.old", path);
+      TCHECK(SD.rename(path, moved));
+      TCHECK(SD.exists(moved) && !SD.exists(path));
+      TCHECK(SD.remove(moved));
+    }
+    files++;
+  }
+  return nullptr;
+}
+
+static void *background(void *arg)
+{
+  (void)arg;
+  while (!stop) {
+    SD.idle();
+    SD.service();
+    DirIterator dir;
+    if (dir.begin("/shared")) {
+      while (dir.next()) {
+      }
+      dir.end();
+    }
+    yield();
+  }
+  return nullptr;
+}
+
+/* All pool entries are free once the Files are closed */
+static void check_pools(void)
+{
+  File open[SD_FILE_POOL];
+  char path[32];
+  int id = -1, iter = -1;
+
+  for (int i = 0; i < SD_FILE_POOL; i++) {
+    snprintf(path, sizeof(path), "/pool%d.bin", i);
+    open[i] = SD.open(path, FILE_WRITE);
+    TCHECK(open[i]);
+    TCHECK((i >= SD_FILE_BUFFERS) || open[i].setBuffer());
+    TCHECK((i >= SD_FLUSH_FILES) || open[i].setFlushPolicy(100));
+  }
+  for (int i = 0; i < SD_FILE_POOL; i++) {
+    open[i].close();
+    snprintf(path, sizeof(path), "/pool%d.bin", i);
+    TCHECK(SD.remove(path));
+  }
+  TCHECK(SD.dataLossWindow() == 0);
+}
+
+int main(void)
+{
+  std::vector<uint8_t> image;
+  static const int counts[] = { 1, 2, 4, 8 };
+
+  CHECK(test_mount(image, 64));
+  CHECK(SD.mkdir("/shared"));
+  for (int threads : counts) {
+    pthread_t tids[8];
+    pthread_t bg;
+    uint32_t start = millis();
+
+    stop = false;
+    files = 0;
+    pthread_create(&bg, nullptr, background, nullptr);
+    for (int i = 0; i < threads; i++) {
+      pthread_create(&tids[i], nullptr, worker, (void *)(intptr_t)i);
+    }
+    for (int i = 0; i < threads; i++) {
+      pthread_join(tids[i], nullptr);
+    }
+    stop = true;
+    pthread_join(bg, nullptr);
+    uint32_t elapsed = millis() - start;
+    printf("%d thread(s): %" PRIu32 " files in %" PRIu32 " ms, %.0f files/s\n",
+           threads, files.load(), elapsed, files * 1000.0 / (elapsed ? elapsed : 1));
+    CHECK(files == (uint32_t)(threads * ITERATIONS));
+    check_pools();
+  }
+  CHECK(SD.poolExhausted() == 0);
+  return test_result("test_sync");
+}
@@ -0,0 +1,61 @@
+/**
+  ******************************************************************************
+  * @file    test_trim.cpp
+  * @brief   Deferred TRIM test: sectors written again are removed from the
+  *          deferred ranges, the sectors around them stay deferred and are
+  *          erased by SD_Trim_Flush().
+  ******************************************************************************
+  */
+#include "host_test.h"
+#include <sd_trim.h>
+
+int main(void)
+{
+  std::vector<uint8_t> image;
+  SD_TrimStats stats;
+
+  CHECK(test_mount(image, 16));
+  SD_Trim_SetPolicy(SD_TRIM_DEFERRED);
+  SD_Trim_Init();
+
+  // Written in the middle: split in two ranges
+  CHECK(SD_Trim_Range(0, 1000, 1099) == RES_OK);
+  SD_Trim_Cancel(1040, 10);
+  CHECK(SD_Trim_Pending() == 90);
+  // Written at both ends: shrunk
+  SD_Trim_Cancel(995, 10);
+  SD_Trim_Cancel(1095, 10);
+  CHECK(SD_Trim_Pending() == 80);
+  // Written across a whole range: removed
+  CHECK(SD_Trim_Range(0, 2000, 2009) == RES_OK);
+  SD_Trim_Cancel(1990, 30);
+  CHECK(SD_Trim_Pending() == 80);
+  // Outside of the ranges: nothing changes
+  SD_Trim_Cancel(1020, 0);
+  SD_Trim_Cancel(1040, 10);
+  CHECK(SD_Trim_Pending() == 80);
+  SD_Trim_GetStats(&stats);
+  CHECK(stats.Cancelled == 30);
+  CHECK(stats.Dropped == 0);
+
+  // No room for the second part of a split: it is dropped
+  for (DWORD i = 1; i < SD_TRIM_RANGES - 1; i++) {
+    CHECK(SD_Trim_Range(0, 3000 + (i * 100), 3009 + (i * 100)) == RES_OK);
+  }
+  CHECK(SD_Trim_Pending() == 80 + ((SD_TRIM_RANGES - 2) * 10));
+  SD_Trim_Cancel(3104, 2);
+  SD_Trim_GetStats(&stats);
+  CHECK(stats.Cancelled == 32);
+  CHECK(stats.Dropped == 4);
+  CHECK(SD_Trim_Pending() == 80 + ((SD_TRIM_RANGES - 2) * 10) - 6);
+
+  // The remaining sectors are erased, one command per range
+  uint32_t pending = SD_Trim_Pending();
+  CHECK(SD_Trim_Flush(0) == RES_OK);
+  SD_Trim_GetStats(&stats);
+  CHECK(SD_Trim_Pending() == 0);
+  CHECK(stats.Trimmed == pending);
+  CHECK(stats.Commands == SD_TRIM_RANGES);
+  CHECK(stats.Errors == 0);
+  return test_result("test_trim");
+}
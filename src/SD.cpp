@@ -54,11 +54,251 @@ extern "C" {
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#ifndef SD_HOST_EMULATION
 #include "stm32_def.h"
+#endif
 }
 #include "STM32SD.h"
+#include "sd_trim.h"
+#include "sd_freemap.h"
+#include "sd_sync.h"
+#include "sd_readahead.h"
 SDClass SD;
 
+/* Lock of a File for the duration of a method (no lock without SD_SYNC) */
+class SdFileLock {
+  public:
+    SdFileLock(const FIL *fil) : _fil(fil)
+    {
+      SD_Sync_LockFile(_fil);
+    };
+    ~SdFileLock()
+    {
+      SD_Sync_UnlockFile(_fil);
+    };
+
+  private:
+    const FIL *_fil;
+};
+
+/* Volume lock for the duration of a block, protecting the File buffers, fast
+   seek tables, flush policies, asynchronous queue and static pools (no lock
+   without SD_SYNC). Waits until granted, only RAM is accessed under it:
+   never call FatFs with it held. */
+class SdVolumeLock {
+  public:
+    SdVolumeLock(void)
+    {
+      while (SD_Sync_LockVolume() == 0) {
+      }
+    };
+    ~SdVolumeLock()
+    {
+      SD_Sync_UnlockVolume();
+    };
+};
+
+static SdFileBuffer _fileBuffers[SD_FILE_BUFFERS];
+static uint32_t _fileBufferPool[SD_FILE_BUFFERS][(SD_FILE_BUFFER_SIZE + 3) / 4];
+
+#if _USE_FASTSEEK
+static SdFastSeek _fastSeeks[SD_FAST_SEEK_TABLES];
+static DWORD _fastSeekPool[SD_FAST_SEEK_TABLES][SD_FAST_SEEK_WORDS];
+#endif
+
+/* Files synced by flushDue() */
+typedef struct {
+  File file;          // copy of the File, sharing its FIL and buffer
+  uint32_t maxAge;    // maximum age of data not synced (ms, 0: unused)
+  uint32_t maxBytes;  // maximum number of bytes not synced (0: unused)
+  uint32_t since;     // millis() of the first write not synced
+  uint32_t bytes;     // bytes written since the last sync
+  bool used;
+} SdFlushEntry;
+static SdFlushEntry _flushFiles[SD_FLUSH_FILES];
+
+/* Queue of the asynchronous requests, served in order by service() */
+static SdAsyncRequest *_asyncHead = nullptr;
+static SdAsyncRequest *_asyncTail = nullptr;
+static bool _asyncServing = false;  // first request being served by a task
+
+#if SD_FILE_POOL > 0
+static FIL _filPool[SD_FILE_POOL];
+static bool _filUsed[SD_FILE_POOL];
+static char _namePool[SD_NAME_POOL][SD_PATH_MAX];
+static bool _nameUsed[SD_NAME_POOL];
+#endif
+static uint32_t _poolExhausted = 0;
+
+/**
+  * @brief  Update the FatFs allocation hint from the free cluster map,
+  *         before FatFs may allocate clusters
+  */
+static void allocationHint(void)
+{
+  if (SD_Sync_LockVolume()) {
+    SD_FreeMap_Hint();
+    SD_Sync_UnlockVolume();
+  }
+}
+
+/**
+  * @brief  Report the completion of an asynchronous request removed from
+  *         the queue. Called without lock held.
+  * @param  req: request
+  * @param  error: true if the transfer failed
+  */
+static void completeAsync(SdAsyncRequest *req, bool error)
+{
+  req->next = nullptr;
+  req->error = error;
+  req->pending = false;
+  // The callback may queue a new request or close the file
+  if (req->callback != nullptr) {
+    req->callback(req);
+  }
+}
+
+/**
+  * @brief  Cancel the asynchronous requests of a file being closed, their
+  *         completion is reported with an error
+  * @param  fil: file object
+  */
+static void cancelAsync(const FIL *fil)
+{
+  SdAsyncRequest *cancelled = nullptr;
+  SdAsyncRequest **last = &cancelled;
+
+  {
+    SdVolumeLock queue;
+    SdAsyncRequest *prev = nullptr;
+    SdAsyncRequest *req = _asyncHead;
+    while (req != nullptr) {
+      SdAsyncRequest *next = req->next;
+      if (req->file._fil == fil) {
+        if (prev == nullptr) {
+          _asyncHead = next;
+        } else {
+          prev->next = next;
+        }
+        if (_asyncTail == req) {
+          _asyncTail = prev;
+        }
+        req->next = nullptr;
+        *last = req;
+        last = &req->next;
+      } else {
+        prev = req;
+      }
+      req = next;
+    }
+  }
+  while (cancelled != nullptr) {
+    SdAsyncRequest *req = cancelled;
+    cancelled = req->next;
+    completeAsync(req, true);
+  }
+}
+
+/**
+  * @brief  Get the flush policy of a file
+  * @param  fil: file object
+  * @retval flush policy or nullptr
+  */
+static SdFlushEntry *flushEntry(const FIL *fil)
+{
+  for (uint8_t i = 0; i < SD_FLUSH_FILES; i++) {
+    if (_flushFiles[i].used && (_flushFiles[i].file._fil == fil)) {
+      return &_flushFiles[i];
+    }
+  }
+  return nullptr;
+}
+
+/**
+  * @brief  Get a copy of a path
+  * @param  path: path to copy
+  * @param  res: set to the error if any
+  * @retval copy or nullptr
+  */
+static char *allocName(const char *path, FRESULT *res)
+{
+  size_t len = strlen(path) + 1;
+#if SD_FILE_POOL > 0
+  if (len > SD_PATH_MAX) {
+    *res = FR_INVALID_NAME;
+    return nullptr;
+  }
+  SdVolumeLock pool;
+  for (uint8_t i = 0; i < SD_NAME_POOL; i++) {
+    if (!_nameUsed[i]) {
+      _nameUsed[i] = true;
+      memcpy(_namePool[i], path, len);
+      return _namePool[i];
+    }
+  }
+  _poolExhausted++;
+  *res = FR_TOO_MANY_OPEN_FILES;
+  return nullptr;
+#else
+  char *name = (char *)malloc(len);
+  if (name == nullptr) {
+    Error_Handler();
+  }
+  UNUSED(res);
+  memcpy(name, path, len);
+  return name;
+#endif
+}
+
+static void freeName(char *name)
+{
+#if SD_FILE_POOL > 0
+  SdVolumeLock pool;
+  _nameUsed[(name - _namePool[0]) / SD_PATH_MAX] = false;
+#else
+  free(name);
+#endif
+}
+
+/**
+  * @brief  Get a file object
+  * @param  res: set to the error if any
+  * @retval file object or nullptr
+  */
+static FIL *allocFil(FRESULT *res)
+{
+#if SD_FILE_POOL > 0
+  SdVolumeLock pool;
+  for (uint8_t i = 0; i < SD_FILE_POOL; i++) {
+    if (!_filUsed[i]) {
+      _filUsed[i] = true;
+      return &_filPool[i];
+    }
+  }
+  _poolExhausted++;
+  *res = FR_TOO_MANY_OPEN_FILES;
+  return nullptr;
+#else
+  FIL *fil = (FIL *)malloc(sizeof(FIL));
+  if (fil == nullptr) {
+    Error_Handler();
+  }
+  UNUSED(res);
+  return fil;
+#endif
+}
+
+static void freeFil(FIL *fil)
+{
+#if SD_FILE_POOL > 0
+  SdVolumeLock pool;
+  _filUsed[fil - _filPool] = false;
+#else
+  free(fil);
+#endif
+}
+
 /**
   * @brief  Link SD, register the file system object to the FatFs mode and configure
   *         relatives SD IOs including SD Detect Pin if any
@@ -67,6 +307,8 @@ SDClass SD;
   */
 bool SDClass::begin(uint32_t detectpin)
 {
+  /* Locks used when the SD is shared by several tasks */
+  SD_Sync_Init();
   /*##-1- Initializes SD IOs #############################################*/
   if (_card.init(detectpin)) {
     return _fatFs.init();
@@ -82,8 +324,15 @@ bool SDClass::begin(uint32_t detectpin)
 bool SDClass::exists(const char *filepath)
 {
   FILINFO fno;
+  FRESULT res;
 
-  if (f_stat(filepath, &fno) != FR_OK) {
+#if _USE_LFN && _FATFS != 68300
+  fno.lfname = nullptr;
+  fno.lfsize = 0;
+#endif
+  res = f_stat(SD._fatFs.enterDir(filepath), &fno);
+  SD._fatFs.leaveDir();
+  if (res != FR_OK) {
     return false;
   } else {
     return true;
@@ -97,7 +346,11 @@ bool SDClass::exists(const char *filepath)
   */
 bool SDClass::mkdir(const char *filepath)
 {
+  allocationHint();
+  SD_Sync_LockPath();
   FRESULT res = f_mkdir(filepath);
+  SD._fatFs.invalidateDirs();
+  SD_Sync_UnlockPath();
   if ((res != FR_OK) && (res != FR_EXIST)) {
     return false;
   } else {
@@ -112,7 +365,11 @@ bool SDClass::mkdir(const char *filepath)
   */
 bool SDClass::rmdir(const char *filepath)
 {
-  if (f_unlink(filepath) != FR_OK) {
+  SD_Sync_LockPath();
+  SD._fatFs.invalidateDirs();
+  FRESULT res = f_unlink(filepath);
+  SD_Sync_UnlockPath();
+  if (res != FR_OK) {
     return false;
   } else {
     return true;
@@ -129,15 +386,16 @@ File SDClass::open(const char *filepath, uint8_t mode /* = FA_READ */)
 {
   File file = File();
 
-  file._name = (char *)malloc(strlen(filepath) + 1);
+  file._name = allocName(filepath, &file._res);
   if (file._name == nullptr) {
-    Error_Handler();
+    return file;
   }
-  sprintf(file._name, "%s", filepath);
 
-  file._fil = (FIL *)malloc(sizeof(FIL));
+  file._fil = allocFil(&file._res);
   if (file._fil == nullptr) {
-    Error_Handler();
+    freeName(file._name);
+    file._name = nullptr;
+    return file;
   }
 
 #if _FATFS == 68300
@@ -148,19 +406,24 @@ File SDClass::open(const char *filepath, uint8_t mode /* = FA_READ */)
   file._dir.fs = 0;
 #endif
   
+  // exists() and f_open() as one step for the other tasks
+  SD_Sync_LockPath();
   if ((mode == FILE_WRITE) && (!SD.exists(filepath))) {
     mode = mode | FA_CREATE_ALWAYS;
   }
 
-  file._res = f_open(file._fil, filepath, mode);
+  const char *path = SD._fatFs.enterDir(filepath);
+  file._res = f_open(file._fil, path, mode);
   if ( file._res != FR_OK) {
-    free(file._fil);
+    freeFil(file._fil);
     file._fil = nullptr;
-    file._res = f_opendir(&file._dir, filepath);
-    if (file._res != FR_OK) {
-      free(file._name);
-      file._name = nullptr;
-    }
+    file._res = f_opendir(&file._dir, path);
+  }
+  SD._fatFs.leaveDir();
+  SD_Sync_UnlockPath();
+  if (file._res != FR_OK) {
+    freeName(file._name);
+    file._name = nullptr;
   }
   return file;
 }
@@ -172,13 +435,222 @@ File SDClass::open(const char *filepath, uint8_t mode /* = FA_READ */)
   */
 bool SDClass::remove(const char *filepath)
 {
-  if (f_unlink(filepath) != FR_OK) {
+  SD_Sync_LockPath();
+  SD._fatFs.invalidateDirs();
+  FRESULT res = f_unlink(filepath);
+  SD_Sync_UnlockPath();
+  if (res != FR_OK) {
     return false;
   } else {
     return true;
   }
 }
 
+/**
+  * @brief  Rename or move a file or directory
+  * @param  from: current path
+  * @param  to: new path, the object must not exist
+  * @retval true if renamed else false
+  */
+bool SDClass::rename(const char *from, const char *to)
+{
+  SD_Sync_LockPath();
+  SD._fatFs.invalidateDirs();
+  FRESULT res = f_rename(from, to);
+  SD_Sync_UnlockPath();
+  if (res != FR_OK) {
+    return false;
+  } else {
+    return true;
+  }
+}
+
+/**
+  * @brief  Get the number of open() which failed because the static pool was exhausted
+  * @retval exhaustion count (always 0 without static pool)
+  */
+uint32_t SDClass::poolExhausted(void)
+{
+  return _poolExhausted;
+}
+
+/**
+  * @brief  Format the card with one FAT partition aligned on the card
+  *         allocation unit, then mount it. All data are lost.
+  * @param  work: work buffer, a larger one speeds up the format. If nullptr,
+  *         a one sector buffer is taken from the stack.
+  * @param  len: size of the work buffer in bytes
+  * @retval true if the card is formatted and ready
+  */
+bool SDClass::format(void *work, uint32_t len)
+{
+  uint32_t sector[_MAX_SS / 4];
+
+  if (work == nullptr) {
+    work = sector;
+    len = sizeof(sector);
+  }
+  return _fatFs.format(_card.details().auSize, work, len);
+}
+
+/**
+  * @brief  Sync the Files whose flush policy is due (see File::setFlushPolicy()).
+  *         Called by idle(). Like the other File and SD calls, to call from
+  *         the task using the card, or from any task with SD_FS_REENTRANT,
+  *         never from an interrupt or a timer callback: it writes to the card.
+  * @retval number of Files synced
+  */
+uint32_t SDClass::flushDue(void)
+{
+  uint32_t synced = 0;
+
+  for (uint8_t i = 0; i < SD_FLUSH_FILES; i++) {
+    SdFlushEntry *entry = &_flushFiles[i];
+    FIL *fil;
+    {
+      SdVolumeLock policies;
+      if (!entry->used) {
+        continue;
+      }
+      fil = entry->file._fil;
+    }
+    SdFileLock lock(fil);
+    // Check again under the File lock
+    if (entry->used && (entry->file._fil == fil) && (entry->bytes != 0) &&
+        (((entry->maxBytes != 0) && (entry->bytes >= entry->maxBytes)) ||
+         ((entry->maxAge != 0) && ((millis() - entry->since) >= entry->maxAge)))) {
+      entry->file.flush();
+      synced++;
+    }
+  }
+  return synced;
+}
+
+/**
+  * @brief  Get the data loss window: what a power loss would lose now
+  * @retval age in ms of the oldest data written and not synced by the Files
+  *         with a flush policy, 0 if all synced
+  */
+uint32_t SDClass::dataLossWindow(void)
+{
+  uint32_t window = 0;
+  uint32_t now = millis();
+  SdVolumeLock policies;
+
+  for (uint8_t i = 0; i < SD_FLUSH_FILES; i++) {
+    if (_flushFiles[i].used && (_flushFiles[i].bytes != 0) &&
+        ((now - _flushFiles[i].since) > window)) {
+      window = now - _flushFiles[i].since;
+    }
+  }
+  return window;
+}
+
+/**
+  * @brief  Serve the queued asynchronous requests (see File::readAsync()):
+  *         transfer the next slice of at most SD_ASYNC_SLICE bytes of the
+  *         first request, or nothing while the card is busy with a background
+  *         transfer. The completion callbacks are called from here.
+  *         To call from loop() until it returns false.
+  * @retval true while requests are pending
+  */
+bool SDClass::service(void)
+{
+  SdAsyncRequest *req;
+  FIL *fil;
+  bool complete = false;
+  bool error = false;
+  uint32_t pos;
+  size_t n;
+  int count;
+
+  {
+    SdVolumeLock queue;
+    req = _asyncHead;
+    if (req == nullptr) {
+      return false;
+    }
+    // Leave the CPU to the application while another task serves the
+    // queue or a prefetch DMA is in progress
+    if (_asyncServing || (SD_ReadAhead_Busy() != 0)) {
+      return true;
+    }
+    _asyncServing = true;
+    fil = req->file._fil;
+  }
+
+  // Under the File lock, so that close() does not cancel the request meanwhile
+  SD_Sync_LockFile(fil);
+  {
+    SdVolumeLock queue;
+    if ((_asyncHead != req) || (req->file._fil != fil)) {
+      // Cancelled by close() before the File lock was taken
+      _asyncServing = false;
+      SD_Sync_UnlockFile(fil);
+      return true;
+    }
+  }
+  // Slices end on SD_ASYNC_SLICE boundaries, to transfer whole sectors
+  pos = req->file.position();
+  n = SD_ASYNC_SLICE - (pos % SD_ASYNC_SLICE);
+  if (n > req->len - req->done) {
+    n = req->len - req->done;
+  }
+  if (n == 0) {
+    // Empty request, a marker in the queue: nothing to transfer, the file
+    // may not be open for reading or writing
+    count = 0;
+  } else if (req->write) {
+    count = (int)req->file.write(&req->data[req->done], n);
+  } else {
+    count = req->file.read(&req->data[req->done], n);
+  }
+  if (count > 0) {
+    req->done += count;
+  }
+  if ((count < 0) || (req->write && ((size_t)count != n))) {
+    complete = true;
+    error = true;
+  } else if ((req->done == req->len) || ((size_t)count != n)) {
+    // Done, or end of file reached by a read
+    complete = true;
+  }
+  {
+    SdVolumeLock queue;
+    if (complete) {
+      _asyncHead = req->next;
+      if (_asyncHead == nullptr) {
+        _asyncTail = nullptr;
+      }
+    }
+    _asyncServing = false;
+  }
+  SD_Sync_UnlockFile(fil);
+  if (complete) {
+    completeAsync(req, error);
+  }
+  SdVolumeLock queue;
+  return _asyncHead != nullptr;
+}
+
+/**
+  * @brief  Run the background work: sync the Files whose flush policy is
+  *         due, erase the sectors freed by FatFs when the deferred TRIM
+  *         policy is used and build the free cluster map. To call when the
+  *         application is idle.
+  * @param  None
+  * @retval None
+  */
+void SDClass::idle(void)
+{
+  flushDue();
+  if (SD_Sync_LockVolume()) {
+    SD_Trim_Flush(0);
+    (void)SD_FreeMap_Build(SD_FREEMAP_IDLE_SECTORS);
+    SD_Sync_UnlockVolume();
+  }
+}
+
 File SDClass::openRoot(void)
 {
   return open(_fatFs.getRoot());
@@ -188,9 +660,622 @@ File::File(FRESULT result /* = FR_OK */)
 {
   _name = nullptr;
   _fil = nullptr;
+  _buf = nullptr;
+  _fsk = nullptr;
   _res = result;
 }
 
+/**
+  * @brief  Set a buffer used to serve read(), peek() and available() from RAM
+  *         (BUF_READ) and/or to combine small writes (BUF_WRITE), written to
+  *         FatFs when reaching a sector boundary and on flush() or close().
+  *         Buffer transfers are aligned on sectors when the size is a multiple of 512.
+  * @param  buf: buffer to use, one of the library is used if nullptr
+  * @param  size: size of buf, 0 to release the current buffer
+  * @param  mode: BUF_READ, BUF_WRITE or both
+  * @retval true if the buffer is set else false (not a file or no buffer available)
+  */
+bool File::setBuffer(uint8_t *buf, size_t size, uint8_t mode)
+{
+  SdFileLock lock(_fil);
+  if (_fil == nullptr) {
+    return false;
+  }
+  // Keep the current buffer while it holds data which cannot be written
+  if (!dropBuffer()) {
+    return false;
+  }
+  releaseBuffer();
+  if (size == 0) {
+    return true;
+  }
+  if ((buf == nullptr) && (size > SD_FILE_BUFFER_SIZE)) {
+    return false;
+  }
+  {
+    SdVolumeLock pool;
+    for (uint8_t i = 0; i < SD_FILE_BUFFERS; i++) {
+      if (!_fileBuffers[i].used) {
+        _buf = &_fileBuffers[i];
+        _buf->used = true;
+        _buf->data = (buf != nullptr) ? buf : (uint8_t *)_fileBufferPool[i];
+        break;
+      }
+    }
+  }
+  if (_buf == nullptr) {
+    return false;
+  }
+  _buf->size = size;
+  _buf->len = 0;
+  _buf->idx = 0;
+  _buf->start = f_tell(_fil);
+  _buf->syncBytes = 0;
+  _buf->syncMs = 0;
+  _buf->unsynced = 0;
+  _buf->lastSync = millis();
+  _buf->mode = mode;
+  _buf->dirty = false;
+  flushRefresh();
+  return true;
+}
+
+/**
+  * @brief  Set when the file is synced while writing
+  * @param  bytes: sync after this number of bytes written, 0 to disable
+  * @param  ms: sync at the first write this delay after the last sync, 0 to disable
+  * @retval true if set else false (no buffer, see setBuffer())
+  */
+bool File::setSyncPolicy(uint32_t bytes, uint32_t ms)
+{
+  SdFileLock lock(_fil);
+  if (_buf == nullptr) {
+    return false;
+  }
+  _buf->syncBytes = bytes;
+  _buf->syncMs = ms;
+  return true;
+}
+
+/**
+  * @brief  Set when the file is synced by SD.flushDue(), called by SD.idle(),
+  *         so that the sync latency is out of the write path
+  * @param  maxAgeMs: sync once the oldest data not synced is this old, 0 to disable
+  * @param  maxBytes: sync once this number of bytes is not synced, 0 to disable
+  * @retval true if set else false (not a file or SD_FLUSH_FILES Files with a policy)
+  */
+bool File::setFlushPolicy(uint32_t maxAgeMs, uint32_t maxBytes)
+{
+  SdFileLock lock(_fil);
+  SdFlushEntry *entry;
+
+  if (_fil == nullptr) {
+    return false;
+  }
+  SdVolumeLock policies;
+  entry = flushEntry(_fil);
+  if ((maxAgeMs == 0) && (maxBytes == 0)) {
+    if (entry != nullptr) {
+      entry->used = false;
+    }
+    return true;
+  }
+  for (uint8_t i = 0; (entry == nullptr) && (i < SD_FLUSH_FILES); i++) {
+    if (!_flushFiles[i].used) {
+      entry = &_flushFiles[i];
+      entry->bytes = 0;
+    }
+  }
+  if (entry == nullptr) {
+    return false;
+  }
+  entry->file = *this;
+  entry->maxAge = maxAgeMs;
+  entry->maxBytes = maxBytes;
+  entry->used = true;
+  return true;
+}
+
+/**
+  * @brief  Account written data for the flush policy, 0 once synced
+  * @param  written: number of bytes written
+  */
+void File::flushTrack(size_t written)
+{
+  SdFlushEntry *entry = flushEntry(_fil);
+
+  if (entry == nullptr) {
+    return;
+  }
+  if (written == 0) {
+    entry->bytes = 0;
+  } else {
+    if (entry->bytes == 0) {
+      entry->since = millis();
+    }
+    entry->bytes += written;
+  }
+}
+
+/**
+  * @brief  Give the current buffer and fast seek table to the copy of the
+  *         File kept by its flush policy
+  */
+void File::flushRefresh(void)
+{
+  SdFlushEntry *entry = flushEntry(_fil);
+
+  if (entry != nullptr) {
+    entry->file._buf = _buf;
+    entry->file._fsk = _fsk;
+  }
+}
+
+/**
+  * @brief  Allocate a contiguous cluster chain to the file, which has to be
+  *         empty. The file size is set to size, data is not initialized.
+  * @param  size: number of bytes to allocate
+  * @retval true if allocated else false (not supported, not empty or no
+  *         contiguous area large enough)
+  */
+bool File::preallocate(uint32_t size)
+{
+  SdFileLock lock(_fil);
+#if (_FATFS == 68300) && (_USE_EXPAND == 1)
+  if (_fil == nullptr) {
+    return false;
+  }
+  if (!dropBuffer()) {
+    return false;
+  }
+  allocationHint();
+  unmapFastSeek(size);
+  _res = f_expand(_fil, size, 1);
+  return (_res == FR_OK);
+#else
+  UNUSED(size);
+  return false;
+#endif
+}
+
+/**
+  * @brief  Use a cluster link map table (CLMT) so that seek() reads no FAT
+  *         sector. The table is built from the FAT chain here, and built
+  *         again by the first seek() following a write which extended the
+  *         cluster chain.
+  * @param  words: size of table in 32-bit words, 0 to release the current table.
+  *         A file in n fragments needs 2 * n + 2 words.
+  * @param  table: table to use, one of the library is used if nullptr
+  * @retval true if enabled else false (not supported, not a file, no table
+  *         available or file too fragmented: FR_NOT_ENOUGH_CORE)
+  */
+bool File::enableFastSeek(size_t words, DWORD *table)
+{
+  SdFileLock lock(_fil);
+#if _USE_FASTSEEK
+  if (_fil == nullptr) {
+    return false;
+  }
+  releaseFastSeek();
+  if (words == 0) {
+    return true;
+  }
+  if ((table == nullptr) && (words > SD_FAST_SEEK_WORDS)) {
+    return false;
+  }
+  {
+    SdVolumeLock pool;
+    for (uint8_t i = 0; i < SD_FAST_SEEK_TABLES; i++) {
+      if (!_fastSeeks[i].used) {
+        _fsk = &_fastSeeks[i];
+        _fsk->used = true;
+        _fsk->table = (table != nullptr) ? table : _fastSeekPool[i];
+        break;
+      }
+    }
+  }
+  if (_fsk == nullptr) {
+    return false;
+  }
+  _fsk->words = words;
+  _fsk->clusters = 0;
+  // The map is built from the chain as stored in the FAT
+  if (!dropBuffer() || !mapFastSeek()) {
+    releaseFastSeek();
+    return false;
+  }
+  flushRefresh();
+  return true;
+#else
+  UNUSED(words);
+  UNUSED(table);
+  return false;
+#endif
+}
+
+#if _USE_FASTSEEK
+/**
+  * @brief  Build the fast seek table from the cluster chain and set it to the FIL
+  * @retval true if the table maps the whole chain else false
+  */
+bool File::mapFastSeek(void)
+{
+  DWORD *tbl = _fsk->table;
+
+  tbl[0] = _fsk->words;
+  _fil->cltbl = tbl;
+  _res = f_lseek(_fil, CREATE_LINKMAP);
+  if (_res != FR_OK) {
+    _fil->cltbl = nullptr;
+    return false;
+  }
+  // Fragments are (clusters, first cluster) pairs ended by 0
+  _fsk->clusters = 0;
+  for (tbl++; *tbl != 0; tbl += 2) {
+    _fsk->clusters += *tbl;
+  }
+  return true;
+}
+
+/**
+  * @brief  Remove the fast seek table from the FIL if a FatFs write ending
+  *         at end would extend the cluster chain: FatFs can not follow a
+  *         chain beyond the table.
+  * @param  end: file position where the write ends
+  */
+void File::unmapFastSeek(uint32_t end)
+{
+  if ((_fsk != nullptr) && (_fil->cltbl != nullptr) && (end != 0)) {
+#if _FATFS == 68300
+    uint32_t clusterSize = (uint32_t)_fil->obj.fs->csize * _MIN_SS;
+#else
+    uint32_t clusterSize = (uint32_t)_fil->fs->csize * _MIN_SS;
+#endif
+    if ((end - 1) / clusterSize >= _fsk->clusters) {
+      _fil->cltbl = nullptr;
+    }
+  }
+}
+#else
+bool File::mapFastSeek(void)
+{
+  return false;
+}
+
+void File::unmapFastSeek(uint32_t end)
+{
+  UNUSED(end);
+}
+#endif
+
+/**
+  * @brief  Give back the fast seek table
+  */
+void File::releaseFastSeek(void)
+{
+  if (_fsk != nullptr) {
+#if _USE_FASTSEEK
+    _fil->cltbl = nullptr;
+#endif
+    {
+      SdVolumeLock pool;
+      _fsk->used = false;
+    }
+    _fsk = nullptr;
+    flushRefresh();
+  }
+}
+
+/**
+  * @brief  Queue a read of len bytes from the current position, served by
+  *         SD.service() which calls callback on completion. The request
+  *         can also be polled: req.pending is false once completed, req.done
+  *         is then the number of bytes read (less than len at end of file)
+  *         and req.error is set on failure.
+  * @param  req: request, must stay valid until completed
+  * @param  buf: buffer to store the read data, must stay valid until completed
+  * @param  len: number of bytes to read
+  * @param  callback: completion callback, nullptr to poll the request
+  * @retval true if queued, false if the request is already pending or the
+  *         file is not open
+  */
+bool File::readAsync(SdAsyncRequest &req, void *buf, size_t len, SdAsyncCallback callback)
+{
+  return queueAsync(req, (uint8_t *)buf, len, callback, false);
+}
+
+/**
+  * @brief  Queue a write of len bytes at the current position, served by
+  *         SD.service() as for readAsync(). req.done is the number of bytes
+  *         written once completed.
+  * @param  req: request, must stay valid until completed
+  * @param  buf: data to write, must stay valid until completed
+  * @param  len: number of bytes to write
+  * @param  callback: completion callback, nullptr to poll the request
+  * @retval true if queued, false if the request is already pending or the
+  *         file is not open
+  */
+bool File::writeAsync(SdAsyncRequest &req, const void *buf, size_t len, SdAsyncCallback callback)
+{
+  return queueAsync(req, (uint8_t *)buf, len, callback, true);
+}
+
+/**
+  * @brief  Add a request to the queue served by SD.service()
+  * @param  req: request
+  * @param  data: caller buffer
+  * @param  len: number of bytes
+  * @param  callback: completion callback
+  * @param  write: true for a write, false for a read
+  * @retval true if queued
+  */
+bool File::queueAsync(SdAsyncRequest &req, uint8_t *data, size_t len, SdAsyncCallback callback, bool write)
+{
+  if (req.pending || (_fil == nullptr) || !*this) {
+    return false;
+  }
+  req.file = *this;
+  req.data = data;
+  req.len = len;
+  req.done = 0;
+  req.callback = callback;
+  req.next = nullptr;
+  req.write = write;
+  req.error = false;
+  req.pending = true;
+  SdVolumeLock queue;
+  if (_asyncTail == nullptr) {
+    _asyncHead = &req;
+  } else {
+    _asyncTail->next = &req;
+  }
+  _asyncTail = &req;
+  return true;
+}
+
+/**
+  * @brief  Write the pending data of the buffer to FatFs. The data not
+  *         written stays in the buffer for the next commit and the error
+  *         is kept in the error state (see getErrorstate()).
+  * @retval true if written else false
+  */
+bool File::commitBuffer(void)
+{
+  UINT byteswritten = 0;
+  UINT len = _buf->len;
+  FRESULT res = FR_OK;
+
+  // The FIL pointer may have moved since a failed commit
+  if (f_tell(_fil) != _buf->start) {
+    res = f_lseek(_fil, _buf->start);
+  }
+  if (res == FR_OK) {
+    allocationHint();
+    unmapFastSeek(_buf->start + len);
+    res = f_write(_fil, _buf->data, len, &byteswritten);
+  }
+  if (byteswritten < len) {
+    memmove(_buf->data, &_buf->data[byteswritten], len - byteswritten);
+  }
+  _buf->start += byteswritten;
+  _buf->len = len - byteswritten;
+  _buf->idx = _buf->len;
+  _buf->dirty = (_buf->len != 0);
+  if (_buf->dirty) {
+    // FatFs reports a full volume as a short write
+    _res = (res != FR_OK) ? res : FR_DENIED;
+    return false;
+  }
+  return true;
+}
+
+/**
+  * @brief  Combine data in the buffer, written to FatFs by sector aligned chunks
+  * @param  data: data to write
+  * @param  size: number of bytes
+  * @retval Number of bytes accepted
+  */
+size_t File::writeBuffer(const uint8_t *data, size_t size)
+{
+  size_t done = 0;
+
+  if (!_buf->dirty) {
+    dropBuffer();
+  }
+  while (done < size) {
+    size_t limit = _buf->size;
+    size_t n = size - done;
+    if (_buf->len == 0) {
+      _buf->start = f_tell(_fil);
+    }
+    // End the chunk on a sector boundary
+    if (limit >= 512) {
+      limit -= _buf->start % 512;
+    }
+    if (_buf->len >= limit) {
+      // Still full of data that a previous commit failed to write
+      if (!commitBuffer()) {
+        return done;
+      }
+      continue;
+    }
+    if ((_buf->len == 0) && (n >= limit)) {
+      // Whole chunk available, no need to copy it
+      UINT byteswritten = 0;
+      unmapFastSeek(f_tell(_fil) + limit);
+      allocationHint();
+      if ((f_write(_fil, &data[done], limit, &byteswritten) != FR_OK) || (byteswritten != limit)) {
+        return done + byteswritten;
+      }
+      _buf->start = f_tell(_fil);
+      done += limit;
+      continue;
+    }
+    if (n > limit - _buf->len) {
+      n = limit - _buf->len;
+    }
+    memcpy(&_buf->data[_buf->len], &data[done], n);
+    _buf->len += n;
+    _buf->idx = _buf->len;
+    _buf->dirty = true;
+    // Accepted once in the buffer, kept there if the commit fails
+    done += n;
+    if ((_buf->len == limit) && !commitBuffer()) {
+      return done;
+    }
+  }
+  return done;
+}
+
+/**
+  * @brief  Fill the buffer from the current FIL position
+  * @retval true if at least one byte is available
+  */
+bool File::fillBuffer(void)
+{
+  UINT bytesread = 0;
+  uint32_t pos;
+  size_t len = _buf->size;
+
+  if (_buf->dirty && !commitBuffer()) {
+    return false;
+  }
+  pos = f_tell(_fil);
+  // End the fill on a sector boundary so that next ones are whole sectors
+  if (len >= 512) {
+    len -= pos % 512;
+  }
+  _buf->start = pos;
+  _buf->idx = 0;
+  if (f_read(_fil, _buf->data, len, &bytesread) != FR_OK) {
+    bytesread = 0;
+    f_lseek(_fil, pos);
+  }
+  _buf->len = bytesread;
+  return (bytesread != 0);
+}
+
+/**
+  * @brief  Write pending data or discard read data of the buffer and move the
+  *         FIL pointer to the current position, before any other FatFs access.
+  * @retval true if done, false if pending data could not be written
+  */
+bool File::dropBuffer(void)
+{
+  if ((_buf != nullptr) && _buf->dirty) {
+    return commitBuffer();
+  } else if ((_buf != nullptr) && (_buf->len != 0)) {
+    if (_buf->idx != _buf->len) {
+      f_lseek(_fil, _buf->start + _buf->idx);
+    }
+    _buf->start += _buf->idx;
+    _buf->len = 0;
+    _buf->idx = 0;
+  }
+  return true;
+}
+
+/**
+  * @brief  Give back the buffer
+  */
+void File::releaseBuffer(void)
+{
+  if (_buf != nullptr) {
+    dropBuffer();
+    {
+      SdVolumeLock pool;
+      _buf->used = false;
+    }
+    _buf = nullptr;
+    flushRefresh();
+  }
+}
+
+/* Output of ls(), written to the Print instance by chunks */
+class LsWriter {
+  public:
+    LsWriter(Print *print) : _print(print), _len(0) {};
+    ~LsWriter()
+    {
+      flush();
+    };
+    void put(char c)
+    {
+      if (_len == sizeof(_buf)) {
+        flush();
+      }
+      _buf[_len++] = c;
+    };
+    void put(const char *str)
+    {
+      while (*str) {
+        put(*str++);
+      }
+    };
+    // Decimal value, at least digits digits
+    void number(uint32_t v, uint8_t digits = 1)
+    {
+      char str[10];
+      uint8_t n = 0;
+      do {
+        str[n++] = '0' + v % 10;
+        v /= 10;
+      } while ((v != 0) || (n < digits));
+      while (n) {
+        put(str[--n]);
+      }
+    };
+    // Quoted dir/name path (name only if dir is empty), escaped for CSV or JSON
+    void quote(const char *dir, const char *name, bool json)
+    {
+      put('"');
+      if (*dir) {
+        escape(dir, json);
+        put('/');
+      }
+      escape(name, json);
+      put('"');
+    };
+    // yyyy-mm-dd hh:mm:ss
+    void dateTime(uint16_t fatDate, uint16_t fatTime)
+    {
+      number(FAT_YEAR(fatDate));
+      put('-');
+      number(FAT_MONTH(fatDate), 2);
+      put('-');
+      number(FAT_DAY(fatDate), 2);
+      put(' ');
+      number(FAT_HOUR(fatTime), 2);
+      put(':');
+      number(FAT_MINUTE(fatTime), 2);
+      put(':');
+      number(FAT_SECOND(fatTime), 2);
+    };
+    void escape(const char *str, bool json)
+    {
+      for (; *str; str++) {
+        if (*str == '"') {
+          put(json ? '\\' : '"');
+        } else if (json && (*str == '\\')) {
+          put('\\');
+        }
+        put(*str);
+      }
+    };
+    void flush(void)
+    {
+      if (_len != 0) {
+        _print->write((const uint8_t *)_buf, _len);
+        _len = 0;
+      }
+    };
+
+  private:
+    Print *_print;
+    size_t _len;
+    char _buf[64];
+};
+
 /** List directory contents to Serial.
  *
  * \param[in] flags The inclusive OR of
@@ -201,17 +1286,31 @@ File::File(FRESULT result /* = FR_OK */)
  *
  * LS_R - Recursive list of subdirectories.
  *
+ * LS_CSV - One "path",type,size,date line per entry (D: directory,
+ * F: file) after a header line. LS_DATE and LS_SIZE are implied.
+ *
+ * LS_JSON - Array of {"path", "dir", "size", "date"} objects.
+ * LS_DATE and LS_SIZE are implied.
+ *
  * \param[in] indent Amount of space before file name. Used for recursive
  * list to indicate subdirectory level.
  * 
  * \param[in] print  Instance responsible to output data (Serial by default)
  * 
+ * Subdirectories are listed without recursion: up to SD_LS_DEPTH levels
+ * below this directory, and as long as their path fits SD_LS_PATH_MAX.
  */
 void File::ls(uint8_t flags, uint8_t indent, Print* print)
 {
   FRESULT res = FR_OK;
   FILINFO fno;
   char *fn;
+  LsWriter out(print);
+  DIR dirs[SD_LS_DEPTH];          // open subdirectories
+  uint16_t ends[SD_LS_DEPTH + 1]; // path length at each level
+  char path[SD_LS_PATH_MAX];      // path of the current subdirectory
+  uint8_t depth = 0;
+  bool first = true;
 
 #if _USE_LFN
 #if _FATFS == 68300
@@ -223,10 +1322,35 @@ void File::ls(uint8_t flags, uint8_t indent, Print* print)
 #endif
 #endif
 
+  ends[0] = strlen(_name);
+  if ((ends[0] > 0) && (_name[ends[0] - 1] == '/')) {
+    ends[0]--;
+  }
+  if (ends[0] >= sizeof(path)) {
+    // Only this directory can be listed
+    ends[0] = 0;
+    flags &= ~LS_R;
+  }
+  memcpy(path, _name, ends[0]);
+  path[ends[0]] = 0;
+
+  if (flags & LS_CSV) {
+    out.put("path,type,size,date\r\n");
+  } else if (flags & LS_JSON) {
+    out.put('[');
+  }
   while (1) {
-    res = f_readdir(&_dir, &fno);
+    DIR *dir = (depth == 0) ? &_dir : &dirs[depth - 1];
+    res = f_readdir(dir, &fno);
     if (res != FR_OK || fno.fname[0] == 0) {
-      break;
+      if (depth == 0) {
+        break;
+      }
+      // Back to the parent directory
+      f_closedir(dir);
+      depth--;
+      path[ends[depth]] = 0;
+      continue;
     }
     if (fno.fname[0] == '.') {
       continue;
@@ -236,52 +1360,76 @@ void File::ls(uint8_t flags, uint8_t indent, Print* print)
 #else
     fn = fno.fname;
 #endif
-    //print any indent spaces
-    for (int8_t i = 0; i < indent; i++) {
-      print->print(' ');
-    }
-    print->print(fn);
-
-    if ((fno.fattrib & AM_DIR) == 0) {
-      // print modify date/time if requested
-      if (flags & LS_DATE) {
-        print->print(' ');
-        printFatDate(fno.fdate, print);
-        print->print(' ');
-        printFatTime(fno.ftime, print);
-      }
-      // print size if requested
-      if (flags & LS_SIZE) {
-        print->print(' ');
-        print->print(fno.fsize);
+    bool isDir = (fno.fattrib & AM_DIR) != 0;
+
+    if (flags & (LS_CSV | LS_JSON)) {
+      // Path relative to this directory, written by parts: not limited to SD_LS_PATH_MAX
+      size_t base = ends[0] + 1;
+      const char *rel = (ends[depth] > base) ? &path[base] : "";
+      if (flags & LS_CSV) {
+        out.quote(rel, fn, false);
+        out.put(isDir ? ",D," : ",F,");
+        out.number(fno.fsize);
+        out.put(',');
+        out.dateTime(fno.fdate, fno.ftime);
+        out.put("\r\n");
+      } else {
+        out.put(first ? "\r\n{\"path\":" : ",\r\n{\"path\":");
+        out.quote(rel, fn, true);
+        out.put(isDir ? ",\"dir\":true,\"size\":" : ",\"dir\":false,\"size\":");
+        out.number(fno.fsize);
+        out.put(",\"date\":\"");
+        out.dateTime(fno.fdate, fno.ftime);
+        out.put("\"}");
       }
-      print->println();
+      first = false;
     } else {
-      // list subdirectory content if requested
-      if (flags & LS_R) {
-        char *fullPath;
-        fullPath = (char *)malloc(strlen(_name) + 1 + strlen(fn) + 1);
-        if (fullPath != nullptr) {
-          sprintf(fullPath, "%s/%s", _name, fn);
-          File filtmp = SD.open(fullPath);
-
-          if (filtmp) {
-            print->println();
-            filtmp.ls(flags, indent + 2, print);
-            filtmp.close();
-          } else {
-            print->println(fn);
-            print->print("Error to open dir: ");
-            print->println(fn);
-          }
-          free(fullPath);
-        } else {
-          print->println();
-          print->print("Error to allocate memory!");
+      //print any indent spaces
+      for (uint16_t i = 0; i < indent + 2 * depth; i++) {
+        out.put(' ');
+      }
+      out.put(fn);
+      if (!isDir) {
+        // print modify date/time if requested
+        if (flags & LS_DATE) {
+          out.put(' ');
+          out.dateTime(fno.fdate, fno.ftime);
         }
+        // print size if requested
+        if (flags & LS_SIZE) {
+          out.put(' ');
+          out.number(fno.fsize);
+        }
+      }
+      out.put("\r\n");
+    }
+
+    // list subdirectory content if requested
+    if (isDir && (flags & LS_R)) {
+      size_t len = ends[depth] + 1 + strlen(fn);
+      if ((depth < SD_LS_DEPTH) && (len < sizeof(path))) {
+        path[ends[depth]] = '/';
+        strcpy(&path[ends[depth] + 1], fn);
+        SD_Sync_LockPath();
+        FRESULT res = f_opendir(&dirs[depth], path);
+        SD_Sync_UnlockPath();
+        if (res == FR_OK) {
+          depth++;
+          ends[depth] = len;
+          continue;
+        }
+        path[ends[depth]] = 0;
+      }
+      if (!(flags & (LS_CSV | LS_JSON))) {
+        out.put("Error to open dir: ");
+        out.put(fn);
+        out.put("\r\n");
       }
     }
   }
+  if (flags & LS_JSON) {
+    out.put(first ? "]\r\n" : "\r\n]\r\n");
+  }
 }
 //------------------------------------------------------------------------------
 /** %Print a directory date field to Serial.
@@ -333,9 +1481,16 @@ void File::printTwoDigits(uint8_t v, Print* print)
   */
 int File::read()
 {
+  SdFileLock lock(_fil);
   UINT byteread;
-  int8_t data;
-  if (f_read(_fil, (void *)&data, 1, (UINT *)&byteread) == FR_OK) {
+  uint8_t data;
+  if (_buf != nullptr) {
+    if ((_buf->idx == _buf->len) && !fillBuffer()) {
+      return -1;
+    }
+    return _buf->data[_buf->idx++];
+  }
+  if ((f_read(_fil, (void *)&data, 1, (UINT *)&byteread) == FR_OK) && (byteread == 1)) {
     return data;
   }
   return -1;
@@ -349,12 +1504,32 @@ int File::read()
   */
 int File::read(void *buf, size_t len)
 {
+  SdFileLock lock(_fil);
   UINT bytesread;
+  size_t n = 0;
 
-  if (f_read(_fil, buf, len, (UINT *)&bytesread) == FR_OK) {
-    return bytesread;
+  if (_buf != nullptr) {
+    n = _buf->len - _buf->idx;
+    if (n > len) {
+      n = len;
+    }
+    memcpy(buf, &_buf->data[_buf->idx], n);
+    _buf->idx += n;
+    if (n == len) {
+      return n;
+    }
+    // Buffer consumed, the FIL pointer is at the current position
+    if (!dropBuffer()) {
+      return (n != 0) ? (int)n : -1;
+    }
   }
-  return -1;
+  if (f_read(_fil, (uint8_t *)buf + n, len - n, (UINT *)&bytesread) == FR_OK) {
+    if (_buf != nullptr) {
+      _buf->start = f_tell(_fil);
+    }
+    return n + bytesread;
+  }
+  return (n != 0) ? (int)n : -1;
 }
 
 /**
@@ -363,9 +1538,13 @@ int File::read(void *buf, size_t len)
   * @param  len: the number of elements to read
   * @retval Number of bytes read
   */
-int File::fgets(TCHAR* buf, UINT len)
+int File::fgets(TCHAR* buf, size_t len)
 {
-  TCHAR* p = f_gets(buf, len, _fil);
+  SdFileLock lock(_fil);
+  if (!dropBuffer()) {
+    return -1;
+  }
+  TCHAR* p = f_gets(buf, (int)len, _fil);
   if(p == 0)
     return -1;
   return strlen((const TCHAR*)p);
@@ -378,7 +1557,12 @@ int File::fgets(TCHAR* buf, UINT len)
   */
 void File::close()
 {
+  SdFileLock lock(_fil);
   if (_name) {
+    releaseBuffer();
+    cancelAsync(_fil);
+    releaseFastSeek();
+    setFlushPolicy(0, 0);
 #if _FATFS == 68300
     if (_fil) {
       if (_fil->obj.fs != 0) {
@@ -386,13 +1570,19 @@ void File::close()
     if (_fil) {
       if (_fil->fs != 0) {
 #endif
-        /* Flush the file before close */
-        f_sync(_fil);
+        /* Flush the file before close, errors are kept in the error state */
+        FRESULT res = f_sync(_fil);
+        if (res != FR_OK) {
+          _res = res;
+        }
 
         /* Close the file */
-        f_close(_fil);
+        res = f_close(_fil);
+        if (res != FR_OK) {
+          _res = res;
+        }
       }
-      free(_fil);
+      freeFil(_fil);
       _fil = nullptr;
     }
 
@@ -404,7 +1594,7 @@ void File::close()
       f_closedir(&_dir);
     }
 
-    free(_name);
+    freeName(_name);
     _name = nullptr;
   }
 }
@@ -417,7 +1607,20 @@ void File::close()
   */
 void File::flush()
 {
-  f_sync(_fil);
+  SdFileLock lock(_fil);
+  // Data the buffer failed to write stays not synced, see getErrorstate()
+  bool committed = dropBuffer();
+  FRESULT res = f_sync(_fil);
+  if (res != FR_OK) {
+    _res = res;
+  }
+  if (committed && (res == FR_OK)) {
+    flushTrack(0);
+    if (_buf != nullptr) {
+      _buf->unsynced = 0;
+      _buf->lastSync = millis();
+    }
+  }
 }
 
 /**
@@ -427,9 +1630,18 @@ void File::flush()
   */
 int File::peek()
 {
+  SdFileLock lock(_fil);
   int data;
+  if (_buf != nullptr) {
+    if ((_buf->idx == _buf->len) && !fillBuffer()) {
+      return -1;
+    }
+    return _buf->data[_buf->idx];
+  }
   data = read();
-  seek(position() - 1);
+  if (data != -1) {
+    seek(position() - 1);
+  }
   return data;
 }
 
@@ -440,7 +1652,11 @@ int File::peek()
   */
 uint32_t File::position()
 {
+  SdFileLock lock(_fil);
   uint32_t filepos = 0;
+  if ((_buf != nullptr) && (_buf->len != 0)) {
+    return _buf->start + _buf->idx;
+  }
   filepos = f_tell(_fil);
   return filepos;
 }
@@ -452,12 +1668,35 @@ uint32_t File::position()
   */
 bool File::seek(uint32_t pos)
 {
+  SdFileLock lock(_fil);
   if (pos > size()) {
     return false;
   } else {
+    if ((_buf != nullptr) && _buf->dirty && !commitBuffer()) {
+      return false;
+    }
+    if ((_buf != nullptr) && (_buf->len != 0) &&
+        (pos >= _buf->start) && (pos <= _buf->start + _buf->len)) {
+      // Inside the buffer, the FIL pointer stays at its end
+      _buf->idx = pos - _buf->start;
+      return true;
+    }
+    if (_buf != nullptr) {
+      _buf->len = 0;
+      _buf->idx = 0;
+    }
+#if _USE_FASTSEEK
+    if ((_fsk != nullptr) && (_fil->cltbl == nullptr) && !mapFastSeek()) {
+      // Chain now too fragmented for the table, seek following the FAT
+      releaseFastSeek();
+    }
+#endif
     if (f_lseek(_fil, pos) != FR_OK) {
       return false;
     } else {
+      if (_buf != nullptr) {
+        _buf->start = pos;
+      }
       return true;
     }
   }
@@ -470,9 +1709,13 @@ bool File::seek(uint32_t pos)
   */
 uint32_t File::size()
 {
+  SdFileLock lock(_fil);
   uint32_t file_size = 0;
 
   file_size = f_size(_fil);
+  if ((_buf != nullptr) && _buf->dirty && (_buf->start + _buf->len > file_size)) {
+    file_size = _buf->start + _buf->len;
+  }
   return (file_size);
 }
 
@@ -502,8 +1745,25 @@ size_t File::write(uint8_t data)
   */
 size_t File::write(const char *buf, size_t size)
 {
-  size_t byteswritten;
-  f_write(_fil, (const void *)buf, size, (UINT *)&byteswritten);
+  SdFileLock lock(_fil);
+  UINT byteswritten = 0;
+
+  if ((_buf != nullptr) && (_buf->mode & BUF_WRITE)) {
+    byteswritten = writeBuffer((const uint8_t *)buf, size);
+  } else if (dropBuffer()) {
+    unmapFastSeek(f_tell(_fil) + size);
+    allocationHint();
+    f_write(_fil, (const void *)buf, size, &byteswritten);
+  }
+  flushTrack(byteswritten);
+  if (_buf != nullptr) {
+    // Apply the sync policy
+    _buf->unsynced += byteswritten;
+    if (((_buf->syncBytes != 0) && (_buf->unsynced >= _buf->syncBytes)) ||
+        ((_buf->syncMs != 0) && ((millis() - _buf->lastSync) >= _buf->syncMs))) {
+      flush();
+    }
+  }
   return byteswritten;
 }
 
@@ -559,6 +1819,7 @@ size_t File::println(String &data)
   */
 int File::available()
 {
+  SdFileLock lock(_fil);
   uint32_t n = size() - position();
   return n > 0x7FFF ? 0x7FFF : n;
 }
@@ -596,7 +1857,9 @@ bool File::isDirectory()
 #endif
     return false;
   // if not init get info
-  if (f_stat(_name, &fno) == FR_OK) {
+  FRESULT res = f_stat(SD._fatFs.enterDir(_name), &fno);
+  SD._fatFs.leaveDir();
+  if (res == FR_OK) {
     if (fno.fattrib & AM_DIR) {
       return true;
     }
@@ -629,19 +1892,31 @@ File File::openNextFile(uint8_t mode)
     fn = fno.fname;
 #endif
     size_t name_len = strlen(_name);
-    char *fullPath = (char *)malloc(name_len + strlen(fn) + 2);
+    size_t path_size = name_len + strlen(fn) + 2;
+#if SD_FILE_POOL > 0
+    char fullPath[SD_PATH_MAX];
+    if (path_size <= sizeof(fullPath)) {
+#else
+    char *fullPath = (char *)malloc(path_size);
     if (fullPath != nullptr) {
-      // Avoid twice '/'
-      if ((name_len > 0)  && (_name[name_len - 1] == '/')) {
-        sprintf(fullPath, "%s%s", _name, fn);
-      } else {
-        sprintf(fullPath, "%s/%s", _name, fn);
+#endif
+      // Avoid twice '/', path_size is checked above
+      memcpy(fullPath, _name, name_len);
+      if ((name_len == 0) || (_name[name_len - 1] != '/')) {
+        fullPath[name_len++] = '/';
       }
+      memcpy(&fullPath[name_len], fn, strlen(fn) + 1);
       File filtmp = SD.open(fullPath, mode);
+#if SD_FILE_POOL == 0
       free(fullPath);
+#endif
       return filtmp;
     } else {
+#if SD_FILE_POOL > 0
+      return File(FR_INVALID_NAME);
+#else
       return File(FR_NOT_ENOUGH_CORE);
+#endif
     }
   }
 }
@@ -656,6 +1931,7 @@ void File::rewindDirectory(void)
 #endif
       f_closedir(&_dir);
     }
-    f_opendir(&_dir, _name);
+    f_opendir(&_dir, SD._fatFs.enterDir(_name));
+    SD._fatFs.leaveDir();
   }
 }
@@ -30,6 +30,99 @@ uint8_t const LS_DATE = 1;
 uint8_t const LS_SIZE = 2;
 /** ls() flag for recursive list of subdirectories */
 uint8_t const LS_R = 4;
+/** ls() flag to print CSV lines: "path",type,size,date */
+uint8_t const LS_CSV = 8;
+/** ls() flag to print a JSON array of {"path","dir","size","date"} */
+uint8_t const LS_JSON = 16;
+
+// modes for setBuffer()
+/** setBuffer() mode to serve reads from the buffer */
+uint8_t const BUF_READ = 1;
+/** setBuffer() mode to combine writes in the buffer */
+uint8_t const BUF_WRITE = 2;
+
+/* Could be redefined in variant.h or using build_opt.h */
+/* Number of File buffers which can be in use at the same time */
+#ifndef SD_FILE_BUFFERS
+#define SD_FILE_BUFFERS 2
+#endif
+/* Size of the File buffers provided by the library (see File::setBuffer()) */
+#ifndef SD_FILE_BUFFER_SIZE
+#define SD_FILE_BUFFER_SIZE 512
+#endif
+
+/* Number of fast seek tables which can be in use at the same time */
+#ifndef SD_FAST_SEEK_TABLES
+#define SD_FAST_SEEK_TABLES 1
+#endif
+/* Size in 32-bit words of the fast seek tables provided by the library
+   (see File::enableFastSeek()), a file in n fragments needs 2 * n + 2 words */
+#ifndef SD_FAST_SEEK_WORDS
+#define SD_FAST_SEEK_WORDS 32
+#endif
+
+/* Maximum subdirectory depth listed by ls() with LS_R */
+#ifndef SD_LS_DEPTH
+#define SD_LS_DEPTH 8
+#endif
+/* Size of the path buffer of ls() with LS_R */
+#ifndef SD_LS_PATH_MAX
+#define SD_LS_PATH_MAX 128
+#endif
+
+/* Number of Files which can have a flush policy at the same time */
+#ifndef SD_FLUSH_FILES
+#define SD_FLUSH_FILES 4
+#endif
+
+/* Maximum number of bytes transferred by each SDClass::service() call, an
+   asynchronous request is served by slices ending on a multiple of it */
+#ifndef SD_ASYNC_SLICE
+#define SD_ASYNC_SLICE 512
+#endif
+
+/* Number of FIL objects of the static pool used by open(), 0 to allocate them on the heap */
+#ifndef SD_FILE_POOL
+#define SD_FILE_POOL 0
+#endif
+/* Number of path strings of the static pool (used by opened files and directories) */
+#ifndef SD_NAME_POOL
+#define SD_NAME_POOL (SD_FILE_POOL + 2)
+#endif
+/* Maximum path length, including the null character, with the static pool */
+#ifndef SD_PATH_MAX
+#define SD_PATH_MAX 64
+#endif
+
+/* File buffer: window [start, start + len) of the file. The FIL pointer is
+   at start + len for read data and at start for pending (dirty) write data */
+typedef struct {
+  uint8_t *data;  // buffer storage
+  size_t size;    // buffer capacity
+  size_t len;     // number of valid bytes
+  size_t idx;     // index of the next byte to read
+  uint32_t start; // file position of data[0]
+  uint32_t syncBytes; // sync policy: bytes written between syncs (0: unused)
+  uint32_t syncMs;    // sync policy: maximum time between syncs (0: unused)
+  uint32_t unsynced;  // bytes written since last sync
+  uint32_t lastSync;  // millis() of last sync
+  uint8_t mode;   // BUF_READ and/or BUF_WRITE
+  bool dirty;     // data holds pending write data
+  bool used;
+} SdFileBuffer;
+
+/* Fast seek: cluster link map table of the file, set to the FIL while it
+   maps the whole cluster chain */
+typedef struct {
+  DWORD *table;      // table storage, table[0] is its size in words
+  size_t words;      // table capacity
+  uint32_t clusters; // number of clusters mapped by the table
+  bool used;
+} SdFastSeek;
+
+struct SdAsyncRequest;
+/* Completion callback of an asynchronous request, called from SDClass::service() */
+typedef void (*SdAsyncCallback)(SdAsyncRequest *req);
 
 // added inheritance of Print, as done in Arduino libs 2022/02 Technik.Gegg
 class File : public Print {
@@ -54,6 +147,26 @@ class File : public Print {
     bool rewind() {
       return seek(0); 
     };
+    // Serve read(), peek() and available() from a RAM buffer and/or combine
+    // writes in it, provided by the library if buf is nullptr.
+    // size 0 releases the buffer.
+    bool setBuffer(uint8_t *buf = nullptr, size_t size = SD_FILE_BUFFER_SIZE, uint8_t mode = BUF_READ);
+    // Sync the file every bytes written and/or ms elapsed (checked on write),
+    // 0 for both: only on flush() and close(). Requires a buffer.
+    bool setSyncPolicy(uint32_t bytes, uint32_t ms = 0);
+    // Sync the file from SD.idle() when written data is older than maxAgeMs
+    // and/or more than maxBytes bytes are not synced, 0 for both: no policy.
+    bool setFlushPolicy(uint32_t maxAgeMs, uint32_t maxBytes = 0);
+    // Reserve a contiguous area of size bytes to this empty file
+    bool preallocate(uint32_t size);
+    // Seek without following the FAT chain using a cluster link map table of
+    // words 32-bit words, provided by the library if table is nullptr.
+    // words 0 releases the table.
+    bool enableFastSeek(size_t words = SD_FAST_SEEK_WORDS, DWORD *table = nullptr);
+    // Queue a read or a write of len bytes at the current position, served
+    // by SD.service(). buf and req must stay valid until req.pending is false.
+    bool readAsync(SdAsyncRequest &req, void *buf, size_t len, SdAsyncCallback callback = nullptr);
+    bool writeAsync(SdAsyncRequest &req, const void *buf, size_t len, SdAsyncCallback callback = nullptr);
 
     char *name(void);
     char *fullname(void)
@@ -79,11 +192,40 @@ class File : public Print {
 
     char *_name = NULL; //file or dir name
     FIL *_fil = NULL; // underlying file object structure pointer
+    SdFileBuffer *_buf = NULL; // optional buffer, shared by the copies of this File
+    SdFastSeek *_fsk = NULL; // optional fast seek table, shared by the copies of this File
     DIR _dir = {}; // init all fields to 0
     FRESULT _res = FR_OK;
 
     FRESULT getErrorstate(void) {return _res;}
 
+  private:
+    bool fillBuffer(void);
+    bool commitBuffer(void);
+    size_t writeBuffer(const uint8_t *data, size_t size);
+    bool dropBuffer(void);
+    void releaseBuffer(void);
+    bool mapFastSeek(void);
+    void unmapFastSeek(uint32_t end);
+    void releaseFastSeek(void);
+    void flushTrack(size_t written);
+    void flushRefresh(void);
+    bool queueAsync(SdAsyncRequest &req, uint8_t *data, size_t len, SdAsyncCallback callback, bool write);
+};
+
+/* Asynchronous read or write request, owned by the caller. The File must not
+   be accessed otherwise while the request is pending. */
+struct SdAsyncRequest {
+  File file;                          // copy of the File, sharing its FIL and buffer
+  uint8_t *data = nullptr;            // caller buffer
+  size_t len = 0;                     // number of bytes requested
+  size_t done = 0;                    // number of bytes transferred
+  SdAsyncCallback callback = nullptr; // called on completion (optional)
+  void *context = nullptr;            // free for the caller
+  SdAsyncRequest *next = nullptr;     // next request of the queue
+  volatile bool pending = false;      // queued and not completed yet
+  bool write = false;
+  bool error = false;                 // transfer failed or cancelled by close()
 };
 
 class SDClass {
@@ -97,8 +239,37 @@ class SDClass {
     static bool mkdir(const char *filepath);
     static bool remove(const char *filepath);
     static bool rmdir(const char *filepath);
+    static bool rename(const char *from, const char *to);
+    // Number of open() which failed because the static pool was exhausted
+    static uint32_t poolExhausted(void);
+    // Background work (deferred TRIM, flush policies), to call when the application is idle
+    static void idle(void);
+    // Sync the Files whose flush policy is due, return the number of Files synced
+    static uint32_t flushDue(void);
+    // Age in ms of the oldest data not synced of the Files with a flush policy
+    static uint32_t dataLossWindow(void);
+    // Serve the next slice of the queued asynchronous requests without
+    // waiting for the card, return true while requests are pending
+    static bool service(void);
+
+    // Volume size and free space in bytes, the free space is not scanned on each call
+    uint64_t totalBytes(void)
+    {
+      return _fatFs.totalBytes();
+    };
+    uint64_t freeBytes(void)
+    {
+      return _fatFs.freeBytes();
+    };
+
+    // Format the card (begin() may have failed on an unformatted card)
+    bool format(void *work = nullptr, uint32_t len = 0);
 
     File openRoot(void);
+    Sd2Card &card(void)
+    {
+      return _card;
+    };
 
     friend class File;
 
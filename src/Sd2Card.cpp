@@ -37,8 +37,29 @@
 #include <Arduino.h>
 #include "Sd2Card.h"
 
+#ifndef STM32L1xx
+/**
+  * @brief  Extract a bit field of a big-endian register
+  * @param  reg: register words, word 0 holds the most significant bits
+  * @param  bits: register size in bits
+  * @param  msb: most significant bit of the field
+  * @param  lsb: least significant bit of the field
+  * @retval field value
+  */
+static uint32_t regBits(const uint32_t *reg, uint32_t bits, uint32_t msb, uint32_t lsb)
+{
+  uint32_t value = 0;
+  for (uint32_t bit = msb + 1; bit-- > lsb;) {
+    uint32_t word = (bits - 1 - bit) / 32;
+    value = (value << 1) | ((reg[word] >> (bit % 32)) & 1);
+  }
+  return value;
+}
+#endif
+
 bool Sd2Card::init(uint32_t detectpin)
 {
+#ifndef SD_HOST_EMULATION
   if (detectpin != SD_DETECT_NONE) {
     PinName p = digitalPinToPinName(detectpin);
     if ((p == NC) || \
@@ -55,8 +76,12 @@ bool Sd2Card::init(uint32_t detectpin)
                         set_GPIO_Port_Clock(STM_PORT(sd_sel)),
                         STM_LL_GPIO_PIN(sd_sel));
 #endif
+#else
+  UNUSED(detectpin);
+#endif /* !SD_HOST_EMULATION */
   if (BSP_SD_Init() == MSD_OK) {
     BSP_SD_GetCardInfo(&_SdCardInfo);
+    (void)readDetails();
     return true;
   }
   return false;
@@ -106,3 +131,78 @@ uint8_t Sd2Card::type(void) const
   return cardType;
 }
 
+bool Sd2Card::readDetails(void)
+{
+  memset(&_details, 0, sizeof(_details));
+#ifndef STM32L1xx
+  static const uint32_t rateUnit[4] = {100, 1000, 10000, 100000}; // kbit/s
+  static const uint8_t rateValue[16] = {0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80};
+  static const uint8_t speedClass[5] = {0, 2, 4, 6, 10};
+  static const uint8_t auLarge[6] = {8, 12, 16, 24, 32, 64}; // MB, AU_SIZE 0xA to 0xF
+  BSP_SD_CardRegisters regs;
+  uint32_t cSize;
+  uint32_t tranSpeed;
+  uint32_t au;
+
+  if (BSP_SD_GetCardRegisters(&regs) != MSD_OK) {
+    return false;
+  }
+  /* CID */
+  _details.manufacturerId = regBits(regs.CID, 128, 127, 120);
+  _details.oemId[0] = regBits(regs.CID, 128, 119, 112);
+  _details.oemId[1] = regBits(regs.CID, 128, 111, 104);
+  for (uint8_t i = 0; i < 5; i++) {
+    _details.productName[i] = regBits(regs.CID, 128, 103 - (8 * i), 96 - (8 * i));
+  }
+  _details.productRevision = regBits(regs.CID, 128, 63, 56);
+  _details.serialNumber = regBits(regs.CID, 128, 55, 24);
+  _details.manufacturingYear = 2000 + regBits(regs.CID, 128, 19, 12);
+  _details.manufacturingMonth = regBits(regs.CID, 128, 11, 8);
+  /* CSD */
+  _details.csdVersion = regBits(regs.CSD, 128, 127, 126) + 1;
+  if (_details.csdVersion == 1) {
+    cSize = regBits(regs.CSD, 128, 73, 62);
+    _details.capacity = (uint64_t)(cSize + 1) << (regBits(regs.CSD, 128, 49, 47) + 2 + regBits(regs.CSD, 128, 83, 80));
+  } else {
+    /* 28 bits C_SIZE for SDUC, 22 bits (upper ones reserved to 0) else */
+    cSize = regBits(regs.CSD, 128, 75, 48);
+    _details.capacity = (uint64_t)(cSize + 1) * 512 * 1024;
+  }
+  _details.blockCount = (_details.capacity / 512 > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)(_details.capacity / 512);
+  _details.commandClasses = regBits(regs.CSD, 128, 95, 84);
+  tranSpeed = regBits(regs.CSD, 128, 103, 96);
+  _details.maxTransferRate = rateUnit[tranSpeed & 0x3] * rateValue[(tranSpeed >> 3) & 0xF] / 10;
+  /* SCR */
+  _details.specVersion = (regBits(regs.SCR, 64, 59, 56) == 0) ? 10 : (regBits(regs.SCR, 64, 59, 56) == 1) ? 11 : 20;
+  if (regBits(regs.SCR, 64, 47, 47)) {
+    _details.specVersion = 30;
+    if (regBits(regs.SCR, 64, 41, 38)) {
+      _details.specVersion = 40 + (10 * regBits(regs.SCR, 64, 41, 38));
+    } else if (regBits(regs.SCR, 64, 42, 42)) {
+      _details.specVersion = 40;
+    }
+  }
+  _details.erasedOnes = regBits(regs.SCR, 64, 55, 55);
+  _details.busWidths = regBits(regs.SCR, 64, 51, 48);
+  _details.cmd23 = regBits(regs.SCR, 64, 33, 33);
+  /* SD status */
+  au = regBits(regs.SSR, 512, 447, 440);
+  _details.speedClass = (au < 5) ? speedClass[au] : 0;
+  _details.uhsGrade = regBits(regs.SSR, 512, 399, 396);
+  _details.videoClass = regBits(regs.SSR, 512, 391, 384);
+  au = regBits(regs.SSR, 512, 431, 428);
+  if (au == 0) {
+    /* UHS_AU_SIZE, same encoding from 0x7 */
+    au = regBits(regs.SSR, 512, 395, 392);
+  }
+  if (au != 0) {
+    _details.auSize = (au < 0xA) ? (16UL * 1024) << (au - 1) : (uint32_t)auLarge[au - 0xA] * 1024 * 1024;
+  }
+  _details.eraseSize = regBits(regs.SSR, 512, 423, 408);
+  _details.eraseTimeout = regBits(regs.SSR, 512, 407, 402);
+  _details.eraseOffset = regBits(regs.SSR, 512, 401, 400);
+  return true;
+#else
+  return false;
+#endif
+}
@@ -50,6 +50,37 @@
 /** High Capacity SD card */
 #define SD_CARD_TYPE_SECURED  4
 
+/** Card registers (CID, CSD, SCR and SD status) decoded */
+typedef struct {
+  /* CID */
+  uint8_t  manufacturerId;
+  char     oemId[3];
+  char     productName[6];
+  uint8_t  productRevision;   // BCD: major in the high nibble
+  uint32_t serialNumber;
+  uint16_t manufacturingYear;
+  uint8_t  manufacturingMonth;
+  /* CSD */
+  uint8_t  csdVersion;        // 1: SDSC, 2: SDHC/SDXC, 3: SDUC
+  uint32_t blockCount;        // Number of 512 bytes blocks
+  uint64_t capacity;          // Bytes
+  uint16_t commandClasses;
+  uint32_t maxTransferRate;   // kbit/s per data line
+  /* SCR */
+  uint8_t  specVersion;       // Physical layer version x10: 10, 11, 20, 30, 40,...
+  uint8_t  busWidths;         // Bit 0: 1 bit, bit 2: 4 bits
+  bool     erasedOnes;        // Erased data is 0xFF (else 0x00)
+  bool     cmd23;             // SET_BLOCK_COUNT support
+  /* SD status */
+  uint8_t  speedClass;        // 0, 2, 4, 6 or 10
+  uint8_t  uhsGrade;          // 0, 1 or 3
+  uint8_t  videoClass;        // 0, 6, 10, 30, 60 or 90
+  uint32_t auSize;            // Allocation unit in bytes, 0 if not defined
+  uint16_t eraseSize;         // Number of AU erased in eraseTimeout, 0 if not supported
+  uint8_t  eraseTimeout;      // Seconds
+  uint8_t  eraseOffset;       // Seconds
+} SdCardDetails;
+
 class Sd2Card {
   public:
 
@@ -58,8 +89,51 @@ class Sd2Card {
     /** Return the card type: SD V1, SD V2 or SDHC */
     uint8_t type(void) const;
 
+    /** Return the card registers decoded at init (all 0 if they could not be read) */
+    const SdCardDetails &details(void) const
+    {
+      return _details;
+    };
+    /** Read and decode the card registers again */
+    bool readDetails(void);
+
+#ifndef STM32L1xx
+    /** Send ACMD23 before multi-block writes so that the card pre-erases the blocks */
+    void setPreErase(bool enable)
+    {
+      BSP_SD_SetPreErase(enable ? 1 : 0);
+    };
+
+    /** Switch the bus speed mode: SD_SPEED_DEFAULT, SD_SPEED_HIGH or SD_SPEED_UHS */
+    bool setBusSpeed(uint8_t speed)
+    {
+      return (BSP_SD_SetBusSpeed(speed) == MSD_OK);
+    };
+    uint8_t busSpeed(void) const
+    {
+      return BSP_SD_GetBusSpeed();
+    };
+
+    /** Set the bus clock divider, the clock is slowed down automatically
+        after SD_CLK_FALLBACK_ERRORS bus errors */
+    bool setClockDivider(uint32_t divider)
+    {
+      return (BSP_SD_SetClockDiv(divider) == MSD_OK);
+    };
+    uint32_t clockDivider(void) const
+    {
+      return BSP_SD_GetClockDiv();
+    };
+    /** Return the number of automatic clock slowdowns */
+    uint32_t clockFallbacks(void) const
+    {
+      return BSP_SD_GetClockFallbacks();
+    };
+#endif
+
   private:
     SD_CardInfo _SdCardInfo;
+    SdCardDetails _details;
 
 };
 #endif  // sd2Card_h
@@ -0,0 +1,216 @@
+/**
+  ******************************************************************************
+  * @file    SdCoroutine.h
+  * @brief   C++20 coroutine interface: awaitable File operations served by
+  *          SD.service(), for cooperative tasks without an RTOS.
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+#ifndef SdCoroutine_h
+#define SdCoroutine_h
+
+#include "STM32SD.h"
+
+/* Only available with a C++20 compiler and library */
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define SD_COROUTINE 1
+#endif
+#endif
+
+#ifdef SD_COROUTINE
+#include <coroutine>
+#include <exception>
+
+/* Cooperative task: a coroutine returning SdTask. It runs until its first
+   co_await then is resumed by SD.service() each time the awaited operation
+   completes. It must not be destroyed before done(). */
+class SdTask {
+  public:
+    struct promise_type {
+      SdTask get_return_object(void)
+      {
+        return SdTask(std::coroutine_handle<promise_type>::from_promise(*this));
+      };
+      std::suspend_never initial_suspend(void) noexcept
+      {
+        return {};
+      };
+      // Keep the frame until the SdTask is destroyed, for done()
+      std::suspend_always final_suspend(void) noexcept
+      {
+        return {};
+      };
+      void return_void(void) {};
+      void unhandled_exception(void)
+      {
+        std::terminate();
+      };
+    };
+
+    SdTask(SdTask &&other) : _handle(other._handle)
+    {
+      other._handle = nullptr;
+    };
+    SdTask(const SdTask &) = delete;
+    SdTask &operator=(const SdTask &) = delete;
+    ~SdTask(void)
+    {
+      if (_handle) {
+        _handle.destroy();
+      }
+    };
+
+    // true once the coroutine has returned
+    bool done(void) const
+    {
+      return !_handle || _handle.done();
+    };
+
+  private:
+    explicit SdTask(std::coroutine_handle<promise_type> handle) : _handle(handle) {};
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+/* Awaitable File operation. Reads and writes are queued as asynchronous
+   requests (see File::readAsync()). sync() and close() wait behind the
+   requests queued before them, then run when SD.service() resumes the task. */
+class SdFileAwaiter {
+  public:
+    enum Op : uint8_t { READ, WRITE, SYNC, CLOSE };
+
+    SdFileAwaiter(File &file, Op op, uint8_t *data = nullptr, size_t len = 0) :
+      _file(file), _data(data), _len(len), _op(op), _queued(false) {};
+
+    bool await_ready(void)
+    {
+      return false;
+    };
+
+    // Queue the request, the task is suspended only if it is queued
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+      _req.context = handle.address();
+      if (_op == WRITE) {
+        _queued = _file.writeAsync(_req, _data, _len, resume);
+      } else {
+        // sync() and close() queue an empty read to keep the order
+        _queued = _file.readAsync(_req, _data, (_op == READ) ? _len : 0, resume);
+      }
+      return _queued;
+    };
+
+    // Number of bytes read or written, -1 on error. 0 or -1 for sync() and close().
+    int await_resume(void)
+    {
+      if (!_queued || _req.error) {
+        return -1;
+      }
+      if (_op == SYNC) {
+        _file.flush();
+      } else if (_op == CLOSE) {
+        _file.close();
+      }
+      return (int)_req.done;
+    };
+
+  private:
+    static void resume(SdAsyncRequest *req)
+    {
+      std::coroutine_handle<>::from_address(req->context).resume();
+    };
+
+    File &_file;
+    SdAsyncRequest _req;
+    uint8_t *_data;
+    size_t _len;
+    Op _op;
+    bool _queued;
+};
+
+/* Awaitable SD.open(). FatFs opens files synchronously: the task is not
+   suspended. The result is true if the file is open. */
+class SdOpenAwaiter {
+  public:
+    SdOpenAwaiter(File &file, const char *path, uint8_t mode) :
+      _file(file), _path(path), _mode(mode) {};
+
+    bool await_ready(void)
+    {
+      return true;
+    };
+    void await_suspend(std::coroutine_handle<>) {};
+    bool await_resume(void)
+    {
+      _file = SD.open(_path, _mode);
+      return (bool)_file;
+    };
+
+  private:
+    File &_file;
+    const char *_path;
+    uint8_t _mode;
+};
+
+/* File with awaitable operations, to co_await from an SdTask:
+     SdCoFile log;
+     if (co_await log.open("log.txt", FILE_WRITE)) {
+       co_await log.write(buf, len);
+       co_await log.close();
+     }
+   The tasks are resumed from SD.service(), to call from loop(). */
+class SdCoFile {
+  public:
+    SdOpenAwaiter open(const char *path, uint8_t mode = FA_READ)
+    {
+      return SdOpenAwaiter(file, path, mode);
+    };
+    SdFileAwaiter read(void *buf, size_t len)
+    {
+      return SdFileAwaiter(file, SdFileAwaiter::READ, (uint8_t *)buf, len);
+    };
+    SdFileAwaiter write(const void *buf, size_t len)
+    {
+      return SdFileAwaiter(file, SdFileAwaiter::WRITE, (uint8_t *)buf, len);
+    };
+    SdFileAwaiter sync(void)
+    {
+      return SdFileAwaiter(file, SdFileAwaiter::SYNC);
+    };
+    SdFileAwaiter close(void)
+    {
+      return SdFileAwaiter(file, SdFileAwaiter::CLOSE);
+    };
+
+    File file;
+};
+
+#endif /* SD_COROUTINE */
+
+#endif
@@ -0,0 +1,154 @@
+/**
+  ******************************************************************************
+  * @file    SdDirIterator.cpp
+  * @brief   Directory iterator: lists the entries of a directory from
+  *          f_readdir, with no path walk, file object nor heap allocation
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+#include <Arduino.h>
+#include "SdDirIterator.h"
+#include "sd_sync.h"
+
+/**
+  * @brief  Open a directory
+  * @param  path: directory path
+  * @retval true if opened else false (see getErrorstate())
+  */
+bool DirIterator::begin(const char *path)
+{
+  size_t len = strlen(path);
+
+  end();
+#if _USE_LFN && _FATFS != 68300
+  _fno.lfname = _lfn;
+  _fno.lfsize = sizeof(_lfn);
+#endif
+  _fno.fname[0] = 0;
+  // Keep the path to open the entries, without trailing '/'
+  if ((len > 0) && (path[len - 1] == '/')) {
+    len--;
+  }
+  _longPath = (len >= sizeof(_path));
+  if (!_longPath) {
+    memcpy(_path, path, len);
+    _path[len] = 0;
+  }
+  // Paths are relative to the FatFs current directory set by the path lookup cache
+  SD_Sync_LockPath();
+  _res = f_opendir(&_dir, path);
+  SD_Sync_UnlockPath();
+  _open = (_res == FR_OK);
+  return _open;
+}
+
+/**
+  * @brief  Read the next entry of the directory
+  * @retval true if an entry is read else false (end of directory or error)
+  */
+bool DirIterator::next(void)
+{
+  if (!_open) {
+    return false;
+  }
+  while (1) {
+    _res = f_readdir(&_dir, &_fno);
+    if ((_res != FR_OK) || (_fno.fname[0] == 0)) {
+      _fno.fname[0] = 0;
+      return false;
+    }
+    if ((_fno.fname[0] == '.') &&
+        ((_fno.fname[1] == 0) || ((_fno.fname[1] == '.') && (_fno.fname[2] == 0)))) {
+      continue;
+    }
+    return true;
+  }
+}
+
+/**
+  * @brief  Go back to the first entry of the directory
+  * @retval true if done else false
+  */
+bool DirIterator::rewind(void)
+{
+  if (!_open) {
+    return false;
+  }
+  _fno.fname[0] = 0;
+  _res = f_readdir(&_dir, nullptr);
+  return (_res == FR_OK);
+}
+
+/**
+  * @brief  Close the directory
+  */
+void DirIterator::end(void)
+{
+  if (_open) {
+    f_closedir(&_dir);
+    _open = false;
+  }
+}
+
+/**
+  * @brief  Get the name of the current entry
+  * @retval long file name if any, "" before the first entry and at the end
+  */
+const char *DirIterator::name(void)
+{
+#if _USE_LFN && _FATFS != 68300
+  if (*_fno.lfname) {
+    return _fno.lfname;
+  }
+#endif
+  return _fno.fname;
+}
+
+/**
+  * @brief  Open the current entry with SD.open()
+  * @param  mode: file open mode
+  * @retval File, false if it can not be opened (FR_INVALID_NAME: path too long)
+  */
+File DirIterator::open(uint8_t mode)
+{
+  char fullPath[SD_PATH_MAX];
+  const char *fn = name();
+  size_t len;
+
+  if ((fn[0] == 0) || _longPath) {
+    return File(FR_INVALID_NAME);
+  }
+  len = strlen(_path);
+  if (len + strlen(fn) + 2 > sizeof(fullPath)) {
+    return File(FR_INVALID_NAME);
+  }
+  memcpy(fullPath, _path, len);
+  fullPath[len] = '/';
+  strcpy(&fullPath[len + 1], fn);
+  return SD.open(fullPath, mode);
+}
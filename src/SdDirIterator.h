@@ -0,0 +1,106 @@
+/**
+  ******************************************************************************
+  * @file    SdDirIterator.h
+  * @brief   Directory iterator: lists the entries of a directory from
+  *          f_readdir without opening them nor allocating memory.
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+#ifndef SdDirIterator_h
+#define SdDirIterator_h
+
+#include "STM32SD.h"
+
+class DirIterator {
+  public:
+    DirIterator(void) {};
+    ~DirIterator(void)
+    {
+      end();
+    };
+
+    // Open the directory, entries are then read one by one with next()
+    bool begin(const char *path);
+    // Read the next entry ("." and ".." skipped), false at the end or on error
+    bool next(void);
+    // Restart from the first entry
+    bool rewind(void);
+    void end(void);
+    // Open the current entry (path limited to SD_PATH_MAX)
+    File open(uint8_t mode = FILE_READ);
+
+    // Current entry
+    const char *name(void);
+    uint32_t size(void)
+    {
+      return (uint32_t)_fno.fsize;
+    };
+    uint8_t attributes(void)
+    {
+      return _fno.fattrib;
+    };
+    bool isDirectory(void)
+    {
+      return (_fno.fattrib & AM_DIR) != 0;
+    };
+    // Modification date and time, FAT format (see FAT_YEAR(), FAT_HOUR()...)
+    uint16_t date(void)
+    {
+      return _fno.fdate;
+    };
+    uint16_t time(void)
+    {
+      return _fno.ftime;
+    };
+    const FILINFO &info(void)
+    {
+      return _fno;
+    };
+
+    FRESULT getErrorstate(void)
+    {
+      return _res;
+    };
+    operator bool()
+    {
+      return _open;
+    };
+
+  private:
+    DIR _dir = {};
+    FILINFO _fno = {};
+#if _USE_LFN && _FATFS != 68300
+    char _lfn[_MAX_LFN + 1];
+#endif
+    char _path[SD_PATH_MAX]; // directory path, without trailing '/'
+    bool _longPath = false;  // path too long to be kept, open() not possible
+    FRESULT _res = FR_OK;
+    bool _open = false;
+};
+
+#endif
@@ -36,21 +36,345 @@
 
 #include <Arduino.h>
 #include "SdFatFs.h"
+#include "sd_block.h"
+#include "sd_cache.h"
+#include "sd_wqueue.h"
+#include "sd_trim.h"
+#include "sd_freemap.h"
+#include "sd_sync.h"
+
+#if (SD_DIR_CACHE_ENTRIES > 0) && (_FS_RPATH >= 1)
+/* Path lookup cache: start cluster of recently used directories */
+typedef struct {
+  char path[SD_DIR_CACHE_PATH_MAX]; // directory path, without leading '/'
+  uint16_t len;                     // path length, 0: unused entry
+  DWORD cluster;                    // first cluster of the directory
+  uint32_t stamp;                   // last use, for LRU replacement
+} SdDirCacheEntry;
+
+static SdDirCacheEntry _dirCache[SD_DIR_CACHE_ENTRIES];
+static uint32_t _dirCacheStamp = 0;
+#endif
 
 bool SdFatFs::init(void)
 {
 
-  /*##-1- Link the SD disk I/O driver ########################################*/
-  if (FATFS_LinkDriver(&SD_Driver, _SDPath) == 0) {
+  /*##-1- Link the SD block layer disk I/O driver ############################*/
+  if ((_SDPath[0] != '\0') || (FATFS_LinkDriver(&SD_BlockDriver, _SDPath) == 0)) {
     /*##-2- Register the file system object to the FatFs module ##############*/
-    if (f_mount(&_SDFatFs, (TCHAR const *)_SDPath, 1) == FR_OK) {
-      /* FatFs Initialization done */
-      return true;
+    return mount();
+  }
+  return false;
+}
+
+bool SdFatFs::mount(void)
+{
+  if (f_mount(&_SDFatFs, (TCHAR const *)_SDPath, 1) == FR_OK) {
+#if SD_CACHE_PIN_FAT
+    /*##-3- Keep the FAT and FAT12/16 root directory in the cache ############*/
+    SD_Cache_UnpinAll();
+    SD_Cache_Pin(_SDFatFs.fatbase, _SDFatFs.fsize);
+    if (_SDFatFs.fs_type != FS_FAT32) {
+      SD_Cache_Pin(_SDFatFs.dirbase, (_SDFatFs.n_rootdir * 32U) / SD_BLOCK_SIZE);
     }
+#endif
+    /* Queued writes of the FAT and FAT12/16 root directory go last */
+    SD_WQueue_SetDataStart(_SDFatFs.database);
+    /* Free cluster map built on demand or when idle */
+    SD_FreeMap_Attach(&_SDFatFs);
+    /* Volume lock shared by FatFs and the block layer */
+    SD_Sync_Attach(&_SDFatFs);
+    invalidateDirs();
+    /* FatFs Initialization done */
+    return true;
   }
   return false;
 }
 
+/**
+  * @brief  Look the directory of path up in the path lookup cache, so that
+  *         FatFs does not walk the path from the root directory again. On a
+  *         miss the directory is entered with f_chdir() and cached. FatFs
+  *         then starts from the current directory, to be restored with
+  *         leaveDir() once the FatFs function called. The path lock is held
+  *         from here to leaveDir(), which must always follow.
+  * @param  path: path of a file or directory
+  * @retval path to give to FatFs: the name in the directory of path, or path
+  *         itself if not cached (root directory, drive number, too long)
+  */
+const char *SdFatFs::enterDir(const char *path)
+{
+  SD_Sync_LockPath();
+#if (SD_DIR_CACHE_ENTRIES > 0) && (_FS_RPATH >= 1)
+  const char *dir = path;
+  const char *name;
+  size_t len;
+  SdDirCacheEntry *entry = &_dirCache[0];
+
+  if (strchr(path, ':') != nullptr) {
+    return path;
+  }
+  while (*dir == '/') {
+    dir++;
+  }
+  name = strrchr(dir, '/');
+  if ((name == nullptr) || (name[1] == '\0')) {
+    return path;
+  }
+  len = name - dir;
+  name++;
+  if ((len == 0) || (len >= SD_DIR_CACHE_PATH_MAX)) {
+    return path;
+  }
+  for (uint8_t i = 0; i < SD_DIR_CACHE_ENTRIES; i++) {
+    if ((_dirCache[i].len == len) && (memcmp(_dirCache[i].path, dir, len) == 0)) {
+      _dirCache[i].stamp = ++_dirCacheStamp;
+      _SDFatFs.cdir = _dirCache[i].cluster;
+      return name;
+    }
+    if (_dirCache[i].stamp < entry->stamp) {
+      entry = &_dirCache[i];
+    }
+  }
+  // Miss: let FatFs walk the path once and keep the directory cluster
+  memcpy(entry->path, dir, len);
+  entry->path[len] = '\0';
+  if (f_chdir(entry->path) != FR_OK) {
+    entry->len = 0;
+    entry->stamp = 0;
+    _SDFatFs.cdir = 0;
+    return path;
+  }
+  entry->len = len;
+  entry->cluster = _SDFatFs.cdir;
+  entry->stamp = ++_dirCacheStamp;
+  return name;
+#else
+  return path;
+#endif
+}
+
+/**
+  * @brief  Go back to the root directory, the reference of the paths given
+  *         to FatFs, after enterDir()
+  */
+void SdFatFs::leaveDir(void)
+{
+#if (SD_DIR_CACHE_ENTRIES > 0) && (_FS_RPATH >= 1)
+  _SDFatFs.cdir = 0;
+#endif
+  SD_Sync_UnlockPath();
+}
+
+/**
+  * @brief  Empty the path lookup cache. To call when a directory may have
+  *         been moved or removed.
+  */
+void SdFatFs::invalidateDirs(void)
+{
+#if (SD_DIR_CACHE_ENTRIES > 0) && (_FS_RPATH >= 1)
+  SD_Sync_LockPath();
+  for (uint8_t i = 0; i < SD_DIR_CACHE_ENTRIES; i++) {
+    _dirCache[i].len = 0;
+    _dirCache[i].stamp = 0;
+  }
+  SD_Sync_UnlockPath();
+#endif
+}
+
+/**
+  * @brief  Convert a LBA to the CHS address of a partition entry (255 heads,
+  *         63 sectors per track, 1023 cylinders max)
+  * @param  chs: 3 bytes of the partition entry
+  * @param  lba: sector
+  */
+static void lbaToChs(uint8_t *chs, uint32_t lba)
+{
+  uint32_t cylinder = lba / (255 * 63);
+  uint8_t head = (lba / 63) % 255;
+  uint8_t sector = (lba % 63) + 1;
+
+  if (cylinder > 1023) {
+    cylinder = 1023;
+    head = 254;
+    sector = 63;
+  }
+  chs[0] = head;
+  chs[1] = ((cylinder >> 2) & 0xC0) | sector;
+  chs[2] = cylinder & 0xFF;
+}
+
+/**
+  * @brief  Format the card as the SD Association formatter does: one
+  *         partition starting on a boundary unit (the AU), data region
+  *         aligned on it and cluster size depending on the capacity.
+  * @param  auSize: allocation unit size of the card in bytes, 0 if unknown
+  * @param  work: work buffer, at least one sector (a larger one speeds up
+  *         the FAT initialization)
+  * @param  len: size of the work buffer in bytes
+  * @retval true if the card is formatted and the volume mounted
+  */
+bool SdFatFs::format(uint32_t auSize, void *work, uint32_t len)
+{
+  BYTE *sector = (BYTE *)work;
+  DWORD sectors = 0;
+  DWORD cluster;
+  DWORD boundary;
+  BYTE type;
+  FRESULT res;
+
+  if ((len < SD_BLOCK_SIZE) ||
+      ((_SDPath[0] == '\0') && (FATFS_LinkDriver(&SD_BlockDriver, _SDPath) != 0))) {
+    return false;
+  }
+  /* Unmount and flush pending writes, the block layer is initialized again by f_mkfs */
+  (void)SD_BlockDriver.disk_ioctl(0, CTRL_SYNC, NULL);
+  SD_FreeMap_Detach();
+  f_mount(NULL, (TCHAR const *)_SDPath, 0);
+  if ((SD_BlockDriver.disk_initialize(0) & STA_NOINIT) ||
+      (SD_BlockDriver.disk_ioctl(0, GET_SECTOR_COUNT, &sectors) != RES_OK)) {
+    return false;
+  }
+
+  /* Cluster size: 8KB up to 8MB, 16KB up to 1GB then 32KB */
+  if (sectors <= (8UL * 2048)) {
+    cluster = 16;
+  } else if (sectors <= (1024UL * 2048)) {
+    cluster = 32;
+  } else {
+    cluster = 64;
+  }
+  /* Boundary unit: the AU, else 4MB for SDHC/SDXC and 64KB for SDSC */
+  if (auSize != 0) {
+    boundary = auSize / SD_BLOCK_SIZE;
+  } else {
+    boundary = (sectors > (2048UL * 2048)) ? 8192 : 128;
+  }
+  while ((boundary > cluster) && ((boundary * 32) > sectors)) {
+    boundary /= 2;
+  }
+  if (boundary < cluster) {
+    boundary = cluster;
+  }
+
+  /* Create the file system in the partition, the data region aligned on the boundary unit */
+  SD_Block_SetWindow(boundary, sectors - boundary, boundary);
+#if _FATFS == 68300
+#if _USE_TRIM == 1
+  /* f_mkfs discards the whole partition */
+  uint8_t policy = SD_Trim_GetPolicy();
+  SD_Trim_SetPolicy(SD_TRIM_IMMEDIATE);
+#endif
+  res = f_mkfs((TCHAR const *)_SDPath, FM_FAT | FM_FAT32 | FM_SFD, cluster * SD_BLOCK_SIZE, work, len);
+#if _USE_TRIM == 1
+  SD_Trim_SetPolicy(policy);
+#endif
+#else
+  res = f_mkfs((TCHAR const *)_SDPath, 1, cluster * SD_BLOCK_SIZE);
+#endif
+  if (res == FR_OK) {
+    res = (f_mount(&_SDFatFs, (TCHAR const *)_SDPath, 1) == FR_OK) ? FR_OK : FR_NO_FILESYSTEM;
+  }
+  type = _SDFatFs.fs_type;
+  f_mount(NULL, (TCHAR const *)_SDPath, 0);
+  SD_Block_SetWindow(0, 0, 0);
+  if (res != FR_OK) {
+    return false;
+  }
+
+  /* Hidden sectors of the boot sector (and of its FAT32 backup) */
+  for (DWORD vbr = boundary; vbr <= boundary + ((type == FS_FAT32) ? 6 : 0); vbr += 6) {
+    if (SD_BlockDriver.disk_read(0, sector, vbr, 1) != RES_OK) {
+      return false;
+    }
+    sector[28] = (BYTE)boundary;
+    sector[29] = (BYTE)(boundary >> 8);
+    sector[30] = (BYTE)(boundary >> 16);
+    sector[31] = (BYTE)(boundary >> 24);
+    if (SD_BlockDriver.disk_write(0, sector, vbr, 1) != RES_OK) {
+      return false;
+    }
+  }
+
+  /* Master boot record */
+  memset(sector, 0, SD_BLOCK_SIZE);
+  BYTE *entry = &sector[446];
+  lbaToChs(&entry[1], boundary);
+  switch (type) {
+    case FS_FAT12:
+      entry[4] = 0x01;
+      break;
+    case FS_FAT16:
+      entry[4] = ((sectors - boundary) < 65536) ? 0x04 : 0x06;
+      break;
+    default:
+      entry[4] = 0x0C;
+      break;
+  }
+  lbaToChs(&entry[5], sectors - 1);
+  for (uint8_t i = 0; i < 4; i++) {
+    entry[8 + i] = (BYTE)(boundary >> (8 * i));
+    entry[12 + i] = (BYTE)((sectors - boundary) >> (8 * i));
+  }
+  sector[510] = 0x55;
+  sector[511] = 0xAA;
+  if ((SD_BlockDriver.disk_write(0, sector, 0, 1) != RES_OK) ||
+      (SD_BlockDriver.disk_ioctl(0, CTRL_SYNC, NULL) != RES_OK)) {
+    return false;
+  }
+  return mount();
+}
+
+/**
+  * @brief  Get the number of free clusters. Taken from the FAT32 FSINFO
+  *         sector when valid, else computed once (FAT scan or free cluster
+  *         map), then maintained by FatFs on each allocation and release.
+  * @retval number of free clusters
+  */
+uint32_t SdFatFs::freeClusters(void)
+{
+  DWORD clusters = 0;
+  FATFS *fs;
+
+  if (_SDFatFs.fs_type == 0) {
+    return 0;
+  }
+  if (_SDFatFs.free_clst <= (_SDFatFs.n_fatent - 2)) {
+    /* Known count, no need to wait for the volume lock */
+    return _SDFatFs.free_clst;
+  }
+  /* Unknown count: the map, when enabled, is faster than the FatFs scan */
+  if (SD_Sync_LockVolume()) {
+    (void)SD_FreeMap_Build(0);
+    SD_Sync_UnlockVolume();
+  }
+  if (f_getfree((TCHAR const *)_SDPath, &clusters, &fs) != FR_OK) {
+    return 0;
+  }
+  return clusters;
+}
+
+/**
+  * @brief  Get the volume size
+  * @retval size of the data area in bytes (0 if not mounted)
+  */
+uint64_t SdFatFs::totalBytes(void) const
+{
+  if (_SDFatFs.fs_type == 0) {
+    return 0;
+  }
+  return (uint64_t)clusterCount() * blocksPerCluster() * _MIN_SS;
+}
+
+/**
+  * @brief  Get the free space of the volume, see freeClusters()
+  * @retval free space in bytes
+  */
+uint64_t SdFatFs::freeBytes(void)
+{
+  return (uint64_t)freeClusters() * blocksPerCluster() * _MIN_SS;
+}
+
 uint8_t SdFatFs::fatType(void)
 {
   switch (_SDFatFs.fs_type) {
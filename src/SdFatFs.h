@@ -42,6 +42,18 @@
 /* FatFs includes component */
 #include "FatFs.h"
 
+/* Could be redefined in variant.h or using build_opt.h */
+/* Number of directories of the path lookup cache, 0 to disable it.
+   Requires _FS_RPATH >= 1 in the FatFs configuration, enabled by the default
+   FatFs configurations when SD_DIR_CACHE_ENTRIES is set. */
+#ifndef SD_DIR_CACHE_ENTRIES
+#define SD_DIR_CACHE_ENTRIES 0
+#endif
+/* Maximum directory path length cached, including the null character */
+#ifndef SD_DIR_CACHE_PATH_MAX
+#define SD_DIR_CACHE_PATH_MAX 64
+#endif
+
 /* To match Arduino definition*/
 #define   FILE_WRITE  FA_WRITE
 #define   FILE_READ   FA_READ
@@ -83,6 +95,9 @@ class SdFatFs {
 
     bool init(void);
 
+    /** Format the card with one partition aligned on its allocation unit (AU) */
+    bool format(uint32_t auSize, void *work, uint32_t len);
+
     /** Return the FatFs type: 12, 16, 32 (0: unknown)*/
     uint8_t fatType(void);
 
@@ -92,17 +107,33 @@ class SdFatFs {
     {
       return _SDFatFs.csize;
     }
+    /** \return The number of free clusters in the volume. */
+    uint32_t freeClusters(void);
     /** \return The total number of clusters in the volume. */
     uint32_t clusterCount(void) const
     {
       return (_SDFatFs.n_fatent - 2);
     }
+    /** \return The size of the volume data area in bytes. */
+    uint64_t totalBytes(void) const;
+    /** \return The free space of the volume in bytes. */
+    uint64_t freeBytes(void);
+
+    /** Path lookup cache: returns the path to give to FatFs, relative to the
+        current directory set to the cached directory of path if any. */
+    const char *enterDir(const char *path);
+    /** Path lookup cache: back to the root directory after enterDir() */
+    void leaveDir(void);
+    /** Path lookup cache: forget the cached directories */
+    void invalidateDirs(void);
 
     char *getRoot(void)
     {
       return _SDPath;
     };
   private:
+    bool mount(void);
+
     FATFS _SDFatFs;  /* File system object for SD disk logical drive */
     char _SDPath[4]; /* SD disk logical drive path */
 };
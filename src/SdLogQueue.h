@@ -0,0 +1,158 @@
+/**
+  ******************************************************************************
+  * @file    SdLogQueue.h
+  * @brief   Log queue: lock-free ring buffer filled from interrupts and
+  *          drained to a File by sector aligned writes.
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+#ifndef SdLogQueue_h
+#define SdLogQueue_h
+
+#include <atomic>
+#include <string.h>
+#include "STM32SD.h"
+
+/* Log queue statistics */
+typedef struct {
+  uint32_t pushed;    // records queued
+  uint32_t overflows; // records dropped, the queue being full
+  uint32_t dropped;   // bytes of the records dropped
+  uint32_t highWater; // maximum number of bytes queued
+} SdLogQueueStats;
+
+/* Queue of N bytes (power of 2, at least one sector). Records are queued
+   whole or dropped by push() from one producer (e.g. one interrupt) without
+   lock, or by pushShared() from several producers. They are written to a
+   file by drain() from the main loop or a task. */
+template <size_t N>
+class SdLogQueue {
+    static_assert((N & (N - 1)) == 0, "SdLogQueue size must be a power of 2");
+    static_assert(N >= 512, "SdLogQueue size must be at least one sector");
+
+  public:
+    SdLogQueue(void) : _head(0), _tail(0) {};
+
+    // Queue a record, single producer. Safe from an interrupt.
+    bool push(const void *data, size_t len)
+    {
+      uint32_t head = _head.load(std::memory_order_relaxed);
+      uint32_t used = head - _tail.load(std::memory_order_acquire);
+
+      if (len > N - used) {
+        _stats.overflows++;
+        _stats.dropped += len;
+        return false;
+      }
+      uint32_t idx = head & (N - 1);
+      size_t first = (len < N - idx) ? len : N - idx;
+      memcpy(&_buf[idx], data, first);
+      memcpy(_buf, (const uint8_t *)data + first, len - first);
+      _head.store(head + len, std::memory_order_release);
+      _stats.pushed++;
+      if (used + len > _stats.highWater) {
+        _stats.highWater = used + len;
+      }
+      return true;
+    };
+
+    // Queue a record, several producers (interrupts of different priorities
+    // and/or tasks): push() with the interrupts masked.
+    bool pushShared(const void *data, size_t len)
+    {
+#ifdef SD_HOST_EMULATION
+      while (_lock.test_and_set(std::memory_order_acquire)) {
+      }
+      bool ret = push(data, len);
+      _lock.clear(std::memory_order_release);
+#else
+      uint32_t primask = __get_PRIMASK();
+      __disable_irq();
+      bool ret = push(data, len);
+      __set_PRIMASK(primask);
+#endif
+      return ret;
+    };
+
+    // Number of bytes queued
+    size_t available(void) const
+    {
+      return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed);
+    };
+
+    // Write the queued bytes to file, single consumer. Without all, only up
+    // to the last sector boundary of the file so that FatFs writes whole
+    // sectors. Returns the number of bytes written.
+    size_t drain(File &file, bool all = false)
+    {
+      uint32_t tail = _tail.load(std::memory_order_relaxed);
+      uint32_t used = _head.load(std::memory_order_acquire) - tail;
+      size_t done = 0;
+
+      if (!all) {
+        // End on a sector boundary of the file, nothing if none is reached
+        uint32_t pos = file.position();
+        uint32_t boundary = (pos + used) & ~(uint32_t)511;
+        used = (boundary > pos) ? boundary - pos : 0;
+      }
+      while (done < used) {
+        uint32_t idx = (tail + done) & (N - 1);
+        size_t len = used - done;
+        if (len > N - idx) {
+          len = N - idx;
+        }
+        size_t written = file.write(&_buf[idx], len);
+        done += written;
+        if (written != len) {
+          break;
+        }
+      }
+      _tail.store(tail + done, std::memory_order_release);
+      return done;
+    };
+
+    // Statistics, reset if reset is true
+    void getStats(SdLogQueueStats *stats, bool reset = false)
+    {
+      *stats = _stats;
+      if (reset) {
+        _stats = SdLogQueueStats();
+      }
+    };
+
+  private:
+    uint8_t _buf[N];
+    std::atomic<uint32_t> _head; // written by the producer
+    std::atomic<uint32_t> _tail; // written by the consumer
+    SdLogQueueStats _stats = {};
+#ifdef SD_HOST_EMULATION
+    std::atomic_flag _lock = ATOMIC_FLAG_INIT;
+#endif
+};
+
+#endif
@@ -0,0 +1,161 @@
+/**
+  ******************************************************************************
+  * @file    SdStreamWriter.cpp
+  * @brief   Streaming writer: writes a preallocated file straight to its
+  *          contiguous sectors with multi-block transfers, bypassing the
+  *          cluster allocation and FAT updates of f_write.
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+#include <Arduino.h>
+#include "SdStreamWriter.h"
+#include "sd_cache.h"
+#include "sd_sync.h"
+
+/**
+  * @brief  Reserve a contiguous area to the file and prepare to stream into it
+  * @param  file: empty file opened for writing
+  * @param  size: number of bytes to reserve
+  * @retval true if the area is reserved else false
+  */
+bool SdStreamWriter::begin(File &file, uint32_t size)
+{
+#if (_FATFS == 68300) && (_USE_EXPAND == 1)
+  if (!file.preallocate(size)) {
+    return false;
+  }
+  _file = file;
+  _fil = file._fil;
+  _lba = _fil->obj.fs->database + (DWORD)(_fil->obj.sclust - 2) * _fil->obj.fs->csize;
+  _capacity = size;
+  _pos = 0;
+  _error = false;
+  return true;
+#else
+  UNUSED(file);
+  UNUSED(size);
+  return false;
+#endif
+}
+
+/**
+  * @brief  Write the sectors following the ones already written
+  * @param  buf: data
+  * @param  count: number of sectors
+  * @retval true if written else false
+  */
+bool SdStreamWriter::writeSectors(const uint8_t *buf, uint32_t count)
+{
+  // Sector of the current position, partial one included
+  DWORD sector = _lba + (_pos / SD_BLOCK_SIZE);
+
+  if (!SD_Sync_LockVolume()) {
+    _error = true;
+    return false;
+  }
+  if (SD_Block_DevWrite(0, buf, sector, count) != RES_OK) {
+    _error = true;
+  } else {
+    // The sectors were written below the cache
+    SD_Cache_Invalidate(sector, count);
+  }
+  SD_Sync_UnlockVolume();
+  return !_error;
+}
+
+/**
+  * @brief  Append data to the file. Whole sectors are written directly from
+  *         buf, in one multi-block transfer.
+  * @param  buf: data
+  * @param  len: number of bytes
+  * @retval Number of bytes written, less than len if the reserved area is full
+  */
+size_t SdStreamWriter::write(const uint8_t *buf, size_t len)
+{
+  size_t done = 0;
+  uint32_t ofs = _pos % SD_BLOCK_SIZE;
+  uint32_t count;
+
+  if ((_fil == nullptr) || _error) {
+    return 0;
+  }
+  if (len > _capacity - _pos) {
+    len = _capacity - _pos;
+  }
+  // Complete the partial sector
+  if (ofs != 0) {
+    done = SD_BLOCK_SIZE - ofs;
+    if (done > len) {
+      done = len;
+    }
+    memcpy((uint8_t *)_sector + ofs, buf, done);
+    if ((ofs + done == SD_BLOCK_SIZE) && !writeSectors((uint8_t *)_sector, 1)) {
+      return 0;
+    }
+    _pos += done;
+  }
+  // Whole sectors
+  count = (len - done) / SD_BLOCK_SIZE;
+  if (count != 0) {
+    if (!writeSectors(&buf[done], count)) {
+      return done;
+    }
+    done += count * SD_BLOCK_SIZE;
+    _pos += count * SD_BLOCK_SIZE;
+  }
+  // Start of the next partial sector
+  if (done < len) {
+    memcpy(_sector, &buf[done], len - done);
+    _pos += len - done;
+    done = len;
+  }
+  return done;
+}
+
+/**
+  * @brief  Write the last partial sector, truncate the file to the written
+  *         size (releasing the clusters not used) and close it
+  * @retval true if done else false
+  */
+bool SdStreamWriter::close(void)
+{
+  bool ret;
+  uint32_t ofs = _pos % SD_BLOCK_SIZE;
+
+  if (_fil == nullptr) {
+    return false;
+  }
+  if ((ofs != 0) && !_error) {
+    memset((uint8_t *)_sector + ofs, 0, SD_BLOCK_SIZE - ofs);
+    writeSectors((uint8_t *)_sector, 1);
+  }
+  ret = !_error && (f_lseek(_fil, _pos) == FR_OK) && (f_truncate(_fil) == FR_OK);
+  _file.close();
+  _fil = nullptr;
+  return ret;
+}
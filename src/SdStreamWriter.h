@@ -0,0 +1,77 @@
+/**
+  ******************************************************************************
+  * @file    SdStreamWriter.h
+  * @brief   Streaming writer: writes a preallocated file straight to its
+  *          contiguous sectors with multi-block transfers.
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+#ifndef SdStreamWriter_h
+#define SdStreamWriter_h
+
+#include "STM32SD.h"
+#include "sd_block.h"
+
+class SdStreamWriter {
+  public:
+    // Preallocate size bytes to the empty file opened for writing
+    bool begin(File &file, uint32_t size);
+    size_t write(const uint8_t *buf, size_t len);
+    size_t write(const char *buf, size_t len)
+    {
+      return write((const uint8_t *)buf, len);
+    };
+    // Write the last partial sector, set the file size and close the file
+    bool close(void);
+
+    uint32_t position(void)
+    {
+      return _pos;
+    };
+    uint32_t capacity(void)
+    {
+      return _capacity;
+    };
+    operator bool()
+    {
+      return (_fil != nullptr) && !_error;
+    };
+
+  private:
+    bool writeSectors(const uint8_t *buf, uint32_t count);
+
+    File _file;
+    FIL *_fil = nullptr;
+    DWORD _lba = 0;         // first sector of the file
+    uint32_t _capacity = 0; // preallocated size
+    uint32_t _pos = 0;      // bytes written
+    bool _error = false;
+    uint32_t _sector[SD_BLOCK_SIZE / 4]; // partial sector
+};
+
+#endif
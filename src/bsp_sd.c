@@ -35,6 +35,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "bsp_sd.h"
+#ifndef SD_HOST_EMULATION
 #include "interrupt.h"
 #include "PeripheralPins.h"
 #include "stm32yyxx_ll_gpio.h"
@@ -50,6 +51,12 @@
 #ifdef SDMMC2
 #define SD_CLK2_ENABLE            __HAL_RCC_SDMMC2_CLK_ENABLE
 #define SD_CLK2_DISABLE           __HAL_RCC_SDMMC2_CLK_DISABLE
+#define SD2_IRQn                  SDMMC2_IRQn
+#endif
+#ifdef SDMMC1
+#define SD_IRQn                   SDMMC1_IRQn
+#else
+#define SD_IRQn                   SDMMC2_IRQn
 #endif
 
 #define SD_CLK_EDGE              SDMMC_CLOCK_EDGE_RISING
@@ -60,6 +67,35 @@
 #define SD_BUS_WIDE_8B           SDMMC_BUS_WIDE_8B
 #define SD_HW_FLOW_CTRL_ENABLE   SDMMC_HARDWARE_FLOW_CONTROL_ENABLE
 #define SD_HW_FLOW_CTRL_DISABLE  SDMMC_HARDWARE_FLOW_CONTROL_DISABLE
+#define SD_CMDINIT_TYPE          SDMMC_CmdInitTypeDef
+#define SD_SEND_COMMAND          SDMMC_SendCommand
+#define SD_RESPONSE_SHORT        SDMMC_RESPONSE_SHORT
+#define SD_WAIT_NO               SDMMC_WAIT_NO
+#define SD_CPSM_ENABLE           SDMMC_CPSM_ENABLE
+#define SD_DATA_INIT_TYPE        SDMMC_DataInitTypeDef
+#define SD_CONFIG_DATA           SDMMC_ConfigData
+#define SD_READ_FIFO             SDMMC_ReadFIFO
+#define SD_DATABLOCK_SIZE_8B     SDMMC_DATABLOCK_SIZE_8B
+#define SD_DATABLOCK_SIZE_64B    SDMMC_DATABLOCK_SIZE_64B
+#define SD_TRANSFER_DIR_TO_HOST  SDMMC_TRANSFER_DIR_TO_SDMMC
+#define SD_DATA_MODE_BLOCK       SDMMC_TRANSFER_MODE_BLOCK
+#define SD_DPSM_ENABLE           SDMMC_DPSM_ENABLE
+#define SD_FLAG_RXOVERR          SDMMC_FLAG_RXOVERR
+#define SD_FLAG_DCRCFAIL         SDMMC_FLAG_DCRCFAIL
+#define SD_FLAG_DTIMEOUT         SDMMC_FLAG_DTIMEOUT
+#define SD_FLAG_DBCKEND          SDMMC_FLAG_DBCKEND
+#define SD_FLAG_DATAEND          SDMMC_FLAG_DATAEND
+#define SD_FLAG_RXFIFOHF         SDMMC_FLAG_RXFIFOHF
+#ifdef SDMMC_FLAG_RXDAVL
+#define SD_RX_DATA_AVAILABLE(h)  __HAL_SD_GET_FLAG(h, SDMMC_FLAG_RXDAVL)
+#else
+#define SD_RX_DATA_AVAILABLE(h)  (!__HAL_SD_GET_FLAG(h, SDMMC_FLAG_RXFIFOE))
+#endif
+#define SD_FLAGS_STATIC          SDMMC_STATIC_FLAGS
+#define SD_CLKCR_CLKDIV          SDMMC_CLKCR_CLKDIV
+#ifdef SDMMC_CLKCR_BYPASS
+#define SD_CLKCR_BYPASS          SDMMC_CLKCR_BYPASS
+#endif
 
 #ifdef STM32H7xx
 #define SD_CLK_DIV               1
@@ -84,7 +120,31 @@
 #define SD_BUS_WIDE_8B           SDIO_BUS_WIDE_8B
 #define SD_HW_FLOW_CTRL_ENABLE   SDIO_HARDWARE_FLOW_CONTROL_ENABLE
 #define SD_HW_FLOW_CTRL_DISABLE  SDIO_HARDWARE_FLOW_CONTROL_DISABLE
+#define SD_CMDINIT_TYPE          SDIO_CmdInitTypeDef
+#define SD_SEND_COMMAND          SDIO_SendCommand
+#define SD_RESPONSE_SHORT        SDIO_RESPONSE_SHORT
+#define SD_WAIT_NO               SDIO_WAIT_NO
+#define SD_CPSM_ENABLE           SDIO_CPSM_ENABLE
+#define SD_DATA_INIT_TYPE        SDIO_DataInitTypeDef
+#define SD_CONFIG_DATA           SDIO_ConfigData
+#define SD_READ_FIFO             SDIO_ReadFIFO
+#define SD_DATABLOCK_SIZE_8B     SDIO_DATABLOCK_SIZE_8B
+#define SD_DATABLOCK_SIZE_64B    SDIO_DATABLOCK_SIZE_64B
+#define SD_TRANSFER_DIR_TO_HOST  SDIO_TRANSFER_DIR_TO_SDIO
+#define SD_DATA_MODE_BLOCK       SDIO_TRANSFER_MODE_BLOCK
+#define SD_DPSM_ENABLE           SDIO_DPSM_ENABLE
+#define SD_FLAG_RXOVERR          SDIO_FLAG_RXOVERR
+#define SD_FLAG_DCRCFAIL         SDIO_FLAG_DCRCFAIL
+#define SD_FLAG_DTIMEOUT         SDIO_FLAG_DTIMEOUT
+#define SD_FLAG_DBCKEND          SDIO_FLAG_DBCKEND
+#define SD_FLAG_DATAEND          SDIO_FLAG_DATAEND
+#define SD_FLAG_RXFIFOHF         SDIO_FLAG_RXFIFOHF
+#define SD_RX_DATA_AVAILABLE(h)  __HAL_SD_GET_FLAG(h, SDIO_FLAG_RXDAVL)
+#define SD_FLAGS_STATIC          SDIO_STATIC_FLAGS
+#define SD_CLKCR_CLKDIV          SDIO_CLKCR_CLKDIV
+#define SD_CLKCR_BYPASS          SDIO_CLKCR_BYPASS
 #define SD_CLK_DIV               SDIO_TRANSFER_CLK_DIV
+#define SD_IRQn                  SDIO_IRQn
 #else
 #error "Unknown SD_INSTANCE"
 #endif
@@ -101,6 +161,59 @@
 #define SD_TRANSCEIVER_MODE      SD_TRANSCEIVER_DISABLE
 #endif
 
+/* ACMD23: number of blocks to pre-erase before a multi-block write */
+#define SD_ACMD_SET_WR_BLK_ERASE_COUNT ((uint8_t)23U)
+
+/* CMD6 argument: switch the function group 1 (access mode) to high speed */
+#define SD_SWITCH_HIGH_SPEED     0x80FFFFF1U
+
+/* Clock divider giving about half of the frequency */
+#ifdef SD_CLKCR_BYPASS
+/* SDIO_CK = SDIOCLK / (CLKDIV + 2) */
+#define SD_CLK_DIV_SLOWER(div)   (((div) * 2U) + 2U)
+#else
+/* SDMMC_CK = SDMMCCLK / (2 * CLKDIV) */
+#define SD_CLK_DIV_SLOWER(div)   (((div) == 0U) ? 1U : ((div) * 2U))
+#endif
+#define SD_CLK_DIV_MAX           (SD_CLKCR_CLKDIV >> POSITION_VAL(SD_CLKCR_CLKDIV))
+
+/* High speed clock of the SDIO/SDMMC without speed mode support: SDIOCLK
+   (bypass) when it does not exceed 50 MHz, else SDIOCLK / 2 */
+#if defined(SD_CLKCR_BYPASS) && !defined(SD_HIGH_SPEED_BYPASS)
+#ifdef STM32F1xx
+#define SD_HIGH_SPEED_BYPASS     0
+#else
+#define SD_HIGH_SPEED_BYPASS     1
+#endif
+#endif
+
+#if BSP_SD_ASYNC
+#ifndef SD_IRQ_PRIO
+#define SD_IRQ_PRIO              5
+#endif
+#ifndef SD_IRQ_SUBPRIO
+#define SD_IRQ_SUBPRIO           0
+#endif
+
+/* SDMMC with internal DMA (IDMA) do not need any DMA stream, the DMA streams
+   of the other ones could be defined in variant.h or using build_opt.h */
+#if !defined(SDMMC_IDMA_IDMAEN) && !defined(SD_DMA_RX_STREAM) && \
+    (defined(STM32F2xx) || defined(STM32F4xx) || defined(STM32F7xx))
+#define SD_DMA_CLK_ENABLE        __HAL_RCC_DMA2_CLK_ENABLE
+#define SD_DMA_CHANNEL           DMA_CHANNEL_4
+#define SD_DMA_RX_STREAM         DMA2_Stream3
+#define SD_DMA_RX_IRQn           DMA2_Stream3_IRQn
+#define SD_DMA_RX_IRQHandler     DMA2_Stream3_IRQHandler
+#define SD_DMA_TX_STREAM         DMA2_Stream6
+#define SD_DMA_TX_IRQn           DMA2_Stream6_IRQn
+#define SD_DMA_TX_IRQHandler     DMA2_Stream6_IRQHandler
+#endif
+
+#ifndef SD_DMA_IRQ_PRIO
+#define SD_DMA_IRQ_PRIO          6
+#endif
+#endif /* BSP_SD_ASYNC */
+
 /* BSP SD Private Variables */
 static SD_HandleTypeDef uSdHandle;
 static uint32_t SD_detect_ll_gpio_pin = LL_GPIO_PIN_ALL;
@@ -115,9 +228,28 @@ static GPIO_TypeDef *SD_trans_sel_gpio_port = GPIOA;
 #define SD_OK                         HAL_OK
 #define SD_TRANSFER_OK                ((uint8_t)0x00)
 #define SD_TRANSFER_BUSY              ((uint8_t)0x01)
+static uint8_t SD_pre_erase = SD_PRE_ERASE;
+static uint8_t SD_bus_speed = SD_SPEED_DEFAULT;
+static uint32_t SD_bus_errors = 0;
+static uint32_t SD_clk_fallbacks = 0;
 #else /* STM32L1xx */
 static SD_CardInfo uSdCardInfo;
 #endif
+#if BSP_SD_ASYNC
+#define SD_XFER_IDLE                  ((uint8_t)0x00)
+#define SD_XFER_BUSY                  ((uint8_t)0x01)
+#define SD_XFER_DONE                  ((uint8_t)0x02)
+#define SD_XFER_ERROR                 ((uint8_t)0x03)
+static volatile uint8_t SD_xfer_state = SD_XFER_IDLE;
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+static uint32_t *SD_xfer_dma_rx_buf = NULL;
+static uint32_t SD_xfer_dma_rx_len = 0;
+#endif
+#ifdef SD_DMA_RX_STREAM
+static DMA_HandleTypeDef SD_dma_rx;
+static DMA_HandleTypeDef SD_dma_tx;
+#endif
+#endif /* BSP_SD_ASYNC */
 
 
 /**
@@ -177,6 +309,14 @@ uint8_t BSP_SD_Init(void)
       sd_state = MSD_OK;
     }
   }
+#ifndef STM32L1xx
+  SD_bus_speed = SD_SPEED_DEFAULT;
+  SD_bus_errors = 0;
+  /* Not supported by the card: stay at default speed */
+  if ((sd_state == MSD_OK) && (SD_BUS_SPEED != SD_SPEED_DEFAULT)) {
+    (void)BSP_SD_SetBusSpeed(SD_BUS_SPEED);
+  }
+#endif
   return  sd_state;
 }
 
@@ -321,6 +461,280 @@ uint8_t BSP_SD_IsDetected(void)
 }
 
 #ifndef STM32L1xx
+/**
+  * @brief  Reads the data block following a command (switch status, SCR or
+  *         SD status) in polling mode.
+  * @param  pData: Pointer to the buffer, big-endian words
+  * @param  Length: Number of bytes to read (8 or 64)
+  * @param  CmdIndex: SDMMC_CMD_HS_SWITCH, SDMMC_CMD_SD_APP_SEND_SCR or SDMMC_CMD_SD_APP_STATUS
+  * @param  Argument: Argument of CMD6
+  * @retval SD status
+  */
+static uint8_t SD_ReadData(uint32_t *pData, uint32_t Length, uint32_t CmdIndex, uint32_t Argument)
+{
+  SD_DATA_INIT_TYPE config;
+  uint32_t count = 0;
+  uint32_t words = Length / 4U;
+  uint32_t tickstart = HAL_GetTick();
+  uint32_t errorstate;
+  uint32_t i;
+  uint8_t sd_state = MSD_OK;
+
+#if BSP_SD_ASYNC
+  if (SD_xfer_state == SD_XFER_BUSY) {
+    return MSD_BUSY;
+  }
+#endif
+  if (SDMMC_CmdBlockLength(uSdHandle.Instance, Length) != HAL_SD_ERROR_NONE) {
+    return MSD_ERROR;
+  }
+  config.DataTimeOut   = SDMMC_DATATIMEOUT;
+  config.DataLength    = Length;
+  config.DataBlockSize = (Length == 8U) ? SD_DATABLOCK_SIZE_8B : SD_DATABLOCK_SIZE_64B;
+  config.TransferDir   = SD_TRANSFER_DIR_TO_HOST;
+  config.TransferMode  = SD_DATA_MODE_BLOCK;
+  config.DPSM          = SD_DPSM_ENABLE;
+  (void)SD_CONFIG_DATA(uSdHandle.Instance, &config);
+
+  if (CmdIndex == SDMMC_CMD_HS_SWITCH) {
+    errorstate = SDMMC_CmdSwitch(uSdHandle.Instance, Argument);
+  } else {
+    errorstate = SDMMC_CmdAppCommand(uSdHandle.Instance, (uint32_t)(uSdHandle.SdCard.RelCardAdd << 16U));
+    if (errorstate == HAL_SD_ERROR_NONE) {
+      errorstate = (CmdIndex == SDMMC_CMD_SD_APP_SEND_SCR) ? SDMMC_CmdSendSCR(uSdHandle.Instance)
+                   : SDMMC_CmdStatusRegister(uSdHandle.Instance);
+    }
+  }
+  if (errorstate != HAL_SD_ERROR_NONE) {
+    sd_state = MSD_ERROR;
+  }
+  while ((sd_state == MSD_OK) &&
+         !__HAL_SD_GET_FLAG(&uSdHandle, SD_FLAG_RXOVERR | SD_FLAG_DCRCFAIL | SD_FLAG_DTIMEOUT |
+                            SD_FLAG_DBCKEND | SD_FLAG_DATAEND)) {
+    if (__HAL_SD_GET_FLAG(&uSdHandle, SD_FLAG_RXFIFOHF) && ((count + 8U) <= words)) {
+      for (i = 0; i < 8U; i++) {
+        pData[count++] = __REV(SD_READ_FIFO(uSdHandle.Instance));
+      }
+    } else if ((words < 8U) && SD_RX_DATA_AVAILABLE(&uSdHandle) && (count < words)) {
+      pData[count++] = __REV(SD_READ_FIFO(uSdHandle.Instance));
+    }
+    if ((HAL_GetTick() - tickstart) >= SDMMC_CMDTIMEOUT) {
+      sd_state = MSD_ERROR;
+    }
+  }
+  if (__HAL_SD_GET_FLAG(&uSdHandle, SD_FLAG_RXOVERR | SD_FLAG_DCRCFAIL | SD_FLAG_DTIMEOUT)) {
+    sd_state = MSD_ERROR;
+  }
+  while (SD_RX_DATA_AVAILABLE(&uSdHandle) && (count < words)) {
+    pData[count++] = __REV(SD_READ_FIFO(uSdHandle.Instance));
+  }
+  __HAL_SD_CLEAR_FLAG(&uSdHandle, SD_FLAGS_STATIC);
+  (void)SDMMC_CmdBlockLength(uSdHandle.Instance, BLOCKSIZE);
+
+  if ((sd_state != MSD_OK) || (count != words)) {
+    return MSD_ERROR;
+  }
+  return MSD_OK;
+}
+
+#if !defined(SDMMC_SPEED_MODE_HIGH)
+/**
+  * @brief  Switches the card to high speed with SWITCH_FUNC (CMD6).
+  * @retval SD status
+  */
+static uint8_t SD_SwitchHighSpeed(void)
+{
+  uint32_t status[16];
+
+  if (SD_ReadData(status, sizeof(status), SDMMC_CMD_HS_SWITCH, SD_SWITCH_HIGH_SPEED) != MSD_OK) {
+    return MSD_ERROR;
+  }
+  /* Bits 379:376: function selected in group 1 */
+  if (((status[4] >> 24) & 0x0FU) != 0x01U) {
+    return MSD_ERROR;
+  }
+  return MSD_OK;
+}
+#endif /* !SDMMC_SPEED_MODE_HIGH */
+
+/**
+  * @brief  Gets the raw card registers, as big-endian words (word 0 holds
+  *         the most significant bits).
+  * @param  Regs: Pointer to the registers structure
+  * @retval SD status
+  */
+uint8_t BSP_SD_GetCardRegisters(BSP_SD_CardRegisters *Regs)
+{
+  uint32_t i;
+
+  for (i = 0; i < 4U; i++) {
+    Regs->CID[i] = uSdHandle.CID[i];
+    Regs->CSD[i] = uSdHandle.CSD[i];
+  }
+  if (SD_ReadData(Regs->SCR, sizeof(Regs->SCR), SDMMC_CMD_SD_APP_SEND_SCR, 0) != MSD_OK) {
+    return MSD_ERROR;
+  }
+  return SD_ReadData(Regs->SSR, sizeof(Regs->SSR), SDMMC_CMD_SD_APP_STATUS, 0);
+}
+
+/**
+  * @brief  Switches the bus speed mode: the card with CMD6 and the bus clock.
+  *         SD_SPEED_UHS requires an SDMMC with speed mode support, an UHS-I
+  *         card and a transceiver (1.8V signaling).
+  * @param  Speed: SD_SPEED_DEFAULT, SD_SPEED_HIGH or SD_SPEED_UHS
+  * @retval SD status, the speed mode is unchanged on error
+  */
+uint8_t BSP_SD_SetBusSpeed(uint8_t Speed)
+{
+#if defined(SDMMC_SPEED_MODE_HIGH)
+  uint32_t mode;
+
+#endif
+#if BSP_SD_ASYNC
+  if (SD_xfer_state == SD_XFER_BUSY) {
+    return MSD_BUSY;
+  }
+#endif
+#if defined(SDMMC_SPEED_MODE_HIGH)
+  switch (Speed) {
+    case SD_SPEED_DEFAULT:
+      mode = SDMMC_SPEED_MODE_DEFAULT;
+      break;
+    case SD_SPEED_HIGH:
+      mode = SDMMC_SPEED_MODE_HIGH;
+      break;
+#ifdef SDMMC_SPEED_MODE_ULTRA
+    case SD_SPEED_UHS:
+      mode = SDMMC_SPEED_MODE_ULTRA;
+      break;
+#endif
+    default:
+      return MSD_ERROR;
+  }
+  if (HAL_SD_ConfigSpeedBusOperation(&uSdHandle, mode) != HAL_OK) {
+    return MSD_ERROR;
+  }
+  /* The HAL selects the clock divider matching the card speed */
+  if (HAL_SD_ConfigWideBusOperation(&uSdHandle, SD_BUS_WIDE) != HAL_OK) {
+    return MSD_ERROR;
+  }
+#else
+  if (Speed == SD_SPEED_HIGH) {
+    if ((SD_bus_speed != SD_SPEED_HIGH) && (SD_SwitchHighSpeed() != MSD_OK)) {
+      return MSD_ERROR;
+    }
+#if SD_HIGH_SPEED_BYPASS
+    SET_BIT(uSdHandle.Instance->CLKCR, SD_CLKCR_BYPASS);
+#else
+    MODIFY_REG(uSdHandle.Instance->CLKCR, SD_CLKCR_CLKDIV, 0U);
+#endif
+  } else if (Speed == SD_SPEED_DEFAULT) {
+    /* The card stays in high speed mode, which is backward compatible */
+#ifdef SD_CLKCR_BYPASS
+    CLEAR_BIT(uSdHandle.Instance->CLKCR, SD_CLKCR_BYPASS);
+#endif
+    MODIFY_REG(uSdHandle.Instance->CLKCR, SD_CLKCR_CLKDIV, SD_CLK_DIV << POSITION_VAL(SD_CLKCR_CLKDIV));
+    uSdHandle.Init.ClockDiv = SD_CLK_DIV;
+  } else {
+    return MSD_ERROR;
+  }
+#endif /* SDMMC_SPEED_MODE_HIGH */
+  SD_bus_speed = Speed;
+  SD_bus_errors = 0;
+  return MSD_OK;
+}
+
+/**
+  * @brief  Gets the bus speed mode.
+  * @retval SD_SPEED_DEFAULT, SD_SPEED_HIGH or SD_SPEED_UHS
+  */
+uint8_t BSP_SD_GetBusSpeed(void)
+{
+  return SD_bus_speed;
+}
+
+/**
+  * @brief  Sets the bus clock divider (CLKDIV field of CLKCR). The resulting
+  *         clock must not exceed the one of the speed mode (25 MHz by default).
+  * @param  ClockDiv: clock divider
+  * @retval SD status
+  */
+uint8_t BSP_SD_SetClockDiv(uint32_t ClockDiv)
+{
+  if (ClockDiv > SD_CLK_DIV_MAX) {
+    return MSD_ERROR;
+  }
+#if BSP_SD_ASYNC
+  if (SD_xfer_state == SD_XFER_BUSY) {
+    return MSD_BUSY;
+  }
+#endif
+#ifdef SD_CLKCR_BYPASS
+  CLEAR_BIT(uSdHandle.Instance->CLKCR, SD_CLKCR_BYPASS);
+#endif
+  MODIFY_REG(uSdHandle.Instance->CLKCR, SD_CLKCR_CLKDIV, ClockDiv << POSITION_VAL(SD_CLKCR_CLKDIV));
+  uSdHandle.Init.ClockDiv = ClockDiv;
+  SD_bus_errors = 0;
+  return MSD_OK;
+}
+
+/**
+  * @brief  Gets the bus clock divider.
+  * @retval clock divider
+  */
+uint32_t BSP_SD_GetClockDiv(void)
+{
+  return READ_BIT(uSdHandle.Instance->CLKCR, SD_CLKCR_CLKDIV) >> POSITION_VAL(SD_CLKCR_CLKDIV);
+}
+
+/**
+  * @brief  Gets the number of automatic clock slowdowns.
+  * @retval number of slowdowns since power up
+  */
+uint32_t BSP_SD_GetClockFallbacks(void)
+{
+  return SD_clk_fallbacks;
+}
+
+/**
+  * @brief  Counts the bus errors (CRC, timeout, FIFO) of a failed transfer and
+  *         slows the bus clock down after SD_CLK_FALLBACK_ERRORS of them.
+  * @param  ErrorCode: HAL SD error code
+  */
+static void SD_BusError(uint32_t ErrorCode)
+{
+#if SD_CLK_FALLBACK_ERRORS > 0
+  uint32_t div;
+
+  if ((ErrorCode & (HAL_SD_ERROR_CMD_CRC_FAIL | HAL_SD_ERROR_DATA_CRC_FAIL |
+                    HAL_SD_ERROR_CMD_RSP_TIMEOUT | HAL_SD_ERROR_DATA_TIMEOUT |
+                    HAL_SD_ERROR_TX_UNDERRUN | HAL_SD_ERROR_RX_OVERRUN)) == 0U) {
+    return;
+  }
+  if (++SD_bus_errors < SD_CLK_FALLBACK_ERRORS) {
+    return;
+  }
+  SD_bus_errors = 0;
+#ifdef SD_CLKCR_BYPASS
+  if (READ_BIT(uSdHandle.Instance->CLKCR, SD_CLKCR_BYPASS)) {
+    /* Bypass: SDIOCLK, CLKDIV 0: SDIOCLK / 2 */
+    CLEAR_BIT(uSdHandle.Instance->CLKCR, SD_CLKCR_BYPASS);
+    MODIFY_REG(uSdHandle.Instance->CLKCR, SD_CLKCR_CLKDIV, 0U);
+    SD_clk_fallbacks++;
+    return;
+  }
+#endif
+  div = SD_CLK_DIV_SLOWER(BSP_SD_GetClockDiv());
+  if (div <= SD_CLK_DIV_MAX) {
+    MODIFY_REG(uSdHandle.Instance->CLKCR, SD_CLKCR_CLKDIV, div << POSITION_VAL(SD_CLKCR_CLKDIV));
+    uSdHandle.Init.ClockDiv = div;
+    SD_clk_fallbacks++;
+  }
+#else
+  UNUSED(ErrorCode);
+#endif
+}
+
 /**
   * @brief  Reads block(s) from a specified address in an SD card, in polling mode.
   * @param  pData: Pointer to the buffer that will contain the data to transmit
@@ -331,11 +745,55 @@ uint8_t BSP_SD_IsDetected(void)
   */
 uint8_t BSP_SD_ReadBlocks(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks, uint32_t Timeout)
 {
+#if SD_TRANSFER_MODE != SD_MODE_POLLING
+  if (SD_xfer_state == SD_XFER_BUSY) {
+    (void)BSP_SD_WaitTransfer(Timeout);
+  }
+  if (BSP_SD_StartReadBlocks(pData, ReadAddr, NumOfBlocks) != MSD_OK) {
+    return MSD_ERROR;
+  }
+  return BSP_SD_WaitTransfer(Timeout);
+#else
   if (HAL_SD_ReadBlocks(&uSdHandle, (uint8_t *)pData, ReadAddr, NumOfBlocks, Timeout) != HAL_OK) {
+    SD_BusError(HAL_SD_GetError(&uSdHandle));
     return MSD_ERROR;
   } else {
     return MSD_OK;
   }
+#endif
+}
+
+/**
+  * @brief  Enables or disables the pre-erase (ACMD23) before multi-block writes.
+  * @param  Enable: 1 to enable, 0 to disable
+  */
+void BSP_SD_SetPreErase(uint8_t Enable)
+{
+  SD_pre_erase = Enable;
+}
+
+/**
+  * @brief  Sends SET_WR_BLK_ERASE_COUNT (ACMD23) so that the card can erase
+  *         the blocks of the next multi-block write in advance. A failure
+  *         is not an error, the write is performed without pre-erase.
+  * @param  NumOfBlocks: Number of SD blocks of the next write
+  */
+static void SD_PreErase(uint32_t NumOfBlocks)
+{
+  SD_CMDINIT_TYPE sdmmc_cmdinit;
+
+  if ((!SD_pre_erase) || (NumOfBlocks < SD_PRE_ERASE_MIN_BLOCKS)) {
+    return;
+  }
+  if (SDMMC_CmdAppCommand(uSdHandle.Instance, (uint32_t)(uSdHandle.SdCard.RelCardAdd << 16U)) == HAL_SD_ERROR_NONE) {
+    sdmmc_cmdinit.Argument         = NumOfBlocks & 0x7FFFFFU;
+    sdmmc_cmdinit.CmdIndex         = SD_ACMD_SET_WR_BLK_ERASE_COUNT;
+    sdmmc_cmdinit.Response         = SD_RESPONSE_SHORT;
+    sdmmc_cmdinit.WaitForInterrupt = SD_WAIT_NO;
+    sdmmc_cmdinit.CPSM             = SD_CPSM_ENABLE;
+    (void)SD_SEND_COMMAND(uSdHandle.Instance, &sdmmc_cmdinit);
+    (void)SDMMC_GetCmdResp1(uSdHandle.Instance, SD_ACMD_SET_WR_BLK_ERASE_COUNT, SDMMC_CMDTIMEOUT);
+  }
 }
 
 /**
@@ -348,12 +806,246 @@ uint8_t BSP_SD_ReadBlocks(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBloc
   */
 uint8_t BSP_SD_WriteBlocks(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks, uint32_t Timeout)
 {
+#if SD_TRANSFER_MODE != SD_MODE_POLLING
+  if (SD_xfer_state == SD_XFER_BUSY) {
+    (void)BSP_SD_WaitTransfer(Timeout);
+  }
+  if (BSP_SD_StartWriteBlocks(pData, WriteAddr, NumOfBlocks) != MSD_OK) {
+    return MSD_ERROR;
+  }
+  return BSP_SD_WaitTransfer(Timeout);
+#else
+  SD_PreErase(NumOfBlocks);
   if (HAL_SD_WriteBlocks(&uSdHandle, (uint8_t *)pData, WriteAddr, NumOfBlocks, Timeout) != HAL_OK) {
+    SD_BusError(HAL_SD_GetError(&uSdHandle));
     return MSD_ERROR;
   } else {
     return MSD_OK;
   }
+#endif
+}
+
+#if BSP_SD_ASYNC
+/**
+  * @brief  Check if a buffer can be transferred by DMA.
+  * @param  pData: Pointer to the buffer
+  * @param  NumOfBlocks: Number of SD blocks to transfer
+  * @retval 1 if DMA can be used else 0
+  */
+static uint8_t SD_DMA_Capable(const uint32_t *pData, uint32_t NumOfBlocks)
+{
+#if !defined(SDMMC_IDMA_IDMAEN)
+  /* DMA streams are set by BSP_SD_MspInit() */
+  if ((uSdHandle.hdmarx == NULL) || (uSdHandle.hdmatx == NULL)) {
+    return 0;
+  }
+#endif
+  if (((uint32_t)pData & 0x3U) != 0) {
+    return 0;
+  }
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+  /* Cache maintenance is done by 32 bytes lines */
+  if ((SCB->CCR & SCB_CCR_DC_Msk) && ((((uint32_t)pData) & 0x1FU) != 0)) {
+    return 0;
+  }
+#endif
+  UNUSED(NumOfBlocks);
+  return 1;
+}
+
+/**
+  * @brief  Starts reading block(s) from a specified address in an SD card, in interrupt mode.
+  *         Completion is reported by BSP_SD_ReadCpltCallback() or BSP_SD_PollTransfer().
+  * @param  pData: Pointer to the buffer that will contain the data to transmit
+  * @param  ReadAddr: Address from where data is to be read
+  * @param  NumOfBlocks: Number of SD blocks to read
+  * @retval SD status
+  */
+uint8_t BSP_SD_ReadBlocks_IT(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks)
+{
+  if (SD_xfer_state == SD_XFER_BUSY) {
+    return MSD_BUSY;
+  }
+  SD_xfer_state = SD_XFER_BUSY;
+  if (HAL_SD_ReadBlocks_IT(&uSdHandle, (uint8_t *)pData, ReadAddr, NumOfBlocks) != HAL_OK) {
+    SD_xfer_state = SD_XFER_IDLE;
+    return MSD_ERROR;
+  }
+  return MSD_OK;
 }
+
+/**
+  * @brief  Starts writing block(s) to a specified address in an SD card, in interrupt mode.
+  *         Completion is reported by BSP_SD_WriteCpltCallback() or BSP_SD_PollTransfer().
+  * @param  pData: Pointer to the buffer that will contain the data to transmit
+  * @param  WriteAddr: Address from where data is to be written
+  * @param  NumOfBlocks: Number of SD blocks to write
+  * @retval SD status
+  */
+uint8_t BSP_SD_WriteBlocks_IT(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks)
+{
+  if (SD_xfer_state == SD_XFER_BUSY) {
+    return MSD_BUSY;
+  }
+  SD_PreErase(NumOfBlocks);
+  SD_xfer_state = SD_XFER_BUSY;
+  if (HAL_SD_WriteBlocks_IT(&uSdHandle, (uint8_t *)pData, WriteAddr, NumOfBlocks) != HAL_OK) {
+    SD_xfer_state = SD_XFER_IDLE;
+    return MSD_ERROR;
+  }
+  return MSD_OK;
+}
+
+/**
+  * @brief  Starts reading block(s) from a specified address in an SD card, in DMA mode.
+  *         Completion is reported by BSP_SD_ReadCpltCallback() or BSP_SD_PollTransfer().
+  * @param  pData: Pointer to the buffer that will contain the data to transmit,
+  *         must be word aligned (32 bytes aligned if the data cache is enabled)
+  * @param  ReadAddr: Address from where data is to be read
+  * @param  NumOfBlocks: Number of SD blocks to read
+  * @retval SD status
+  */
+uint8_t BSP_SD_ReadBlocks_DMA(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks)
+{
+  if (SD_xfer_state == SD_XFER_BUSY) {
+    return MSD_BUSY;
+  }
+  if (!SD_DMA_Capable(pData, NumOfBlocks)) {
+    return MSD_ERROR;
+  }
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+  SD_xfer_dma_rx_buf = pData;
+  SD_xfer_dma_rx_len = NumOfBlocks * BLOCKSIZE;
+  if (SCB->CCR & SCB_CCR_DC_Msk) {
+    /* Drop the cached lines of the buffer before the transfer: a dirty line
+       evicted during the DMA would overwrite the data read. They are
+       invalidated again on completion, for the lines speculatively read. */
+    SCB_InvalidateDCache_by_Addr(pData, (int32_t)(NumOfBlocks * BLOCKSIZE));
+  }
+#endif
+  SD_xfer_state = SD_XFER_BUSY;
+  if (HAL_SD_ReadBlocks_DMA(&uSdHandle, (uint8_t *)pData, ReadAddr, NumOfBlocks) != HAL_OK) {
+    SD_xfer_state = SD_XFER_IDLE;
+    return MSD_ERROR;
+  }
+  return MSD_OK;
+}
+
+/**
+  * @brief  Starts writing block(s) to a specified address in an SD card, in DMA mode.
+  *         Completion is reported by BSP_SD_WriteCpltCallback() or BSP_SD_PollTransfer().
+  * @param  pData: Pointer to the buffer that will contain the data to transmit,
+  *         must be word aligned (32 bytes aligned if the data cache is enabled)
+  * @param  WriteAddr: Address from where data is to be written
+  * @param  NumOfBlocks: Number of SD blocks to write
+  * @retval SD status
+  */
+uint8_t BSP_SD_WriteBlocks_DMA(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks)
+{
+  if (SD_xfer_state == SD_XFER_BUSY) {
+    return MSD_BUSY;
+  }
+  if (!SD_DMA_Capable(pData, NumOfBlocks)) {
+    return MSD_ERROR;
+  }
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+  if (SCB->CCR & SCB_CCR_DC_Msk) {
+    SCB_CleanDCache_by_Addr(pData, (int32_t)(NumOfBlocks * BLOCKSIZE));
+  }
+#endif
+  SD_PreErase(NumOfBlocks);
+  SD_xfer_state = SD_XFER_BUSY;
+  if (HAL_SD_WriteBlocks_DMA(&uSdHandle, (uint8_t *)pData, WriteAddr, NumOfBlocks) != HAL_OK) {
+    SD_xfer_state = SD_XFER_IDLE;
+    return MSD_ERROR;
+  }
+  return MSD_OK;
+}
+
+/**
+  * @brief  Starts reading block(s), in DMA mode if enabled and possible for
+  *         this buffer else in interrupt mode.
+  * @param  pData: Pointer to the buffer that will contain the data to transmit
+  * @param  ReadAddr: Address from where data is to be read
+  * @param  NumOfBlocks: Number of SD blocks to read
+  * @retval SD status
+  */
+uint8_t BSP_SD_StartReadBlocks(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks)
+{
+#if SD_TRANSFER_MODE == SD_MODE_DMA
+  if (SD_DMA_Capable(pData, NumOfBlocks)) {
+    return BSP_SD_ReadBlocks_DMA(pData, ReadAddr, NumOfBlocks);
+  }
+#endif
+  return BSP_SD_ReadBlocks_IT(pData, ReadAddr, NumOfBlocks);
+}
+
+/**
+  * @brief  Starts writing block(s), in DMA mode if enabled and possible for
+  *         this buffer else in interrupt mode.
+  * @param  pData: Pointer to the buffer that will contain the data to transmit
+  * @param  WriteAddr: Address from where data is to be written
+  * @param  NumOfBlocks: Number of SD blocks to write
+  * @retval SD status
+  */
+uint8_t BSP_SD_StartWriteBlocks(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks)
+{
+#if SD_TRANSFER_MODE == SD_MODE_DMA
+  if (SD_DMA_Capable(pData, NumOfBlocks)) {
+    return BSP_SD_WriteBlocks_DMA(pData, WriteAddr, NumOfBlocks);
+  }
+#endif
+  return BSP_SD_WriteBlocks_IT(pData, WriteAddr, NumOfBlocks);
+}
+
+/**
+  * @brief  Gets the status of the last started transfer, including the card
+  *         busy (programming) phase of a write.
+  * @retval MSD_OK: transfer done and card ready, MSD_BUSY: in progress,
+  *         MSD_ERROR: transfer failed
+  */
+uint8_t BSP_SD_PollTransfer(void)
+{
+  switch (SD_xfer_state) {
+    case SD_XFER_BUSY:
+      return MSD_BUSY;
+    case SD_XFER_ERROR:
+      SD_xfer_state = SD_XFER_IDLE;
+      SD_BusError(HAL_SD_GetError(&uSdHandle));
+      return MSD_ERROR;
+    default:
+      break;
+  }
+  if (BSP_SD_GetCardState() != SD_TRANSFER_OK) {
+    return MSD_BUSY;
+  }
+  SD_xfer_state = SD_XFER_IDLE;
+  return MSD_OK;
+}
+
+/**
+  * @brief  Waits for the end of the last started transfer.
+  * @param  Timeout: Timeout in ms, the transfer is aborted when elapsed
+  * @retval SD status
+  */
+uint8_t BSP_SD_WaitTransfer(uint32_t Timeout)
+{
+  uint32_t tickstart = HAL_GetTick();
+  uint8_t sd_state;
+
+  while ((sd_state = BSP_SD_PollTransfer()) == MSD_BUSY) {
+    if ((HAL_GetTick() - tickstart) >= Timeout) {
+      if (SD_xfer_state == SD_XFER_BUSY) {
+        HAL_SD_Abort(&uSdHandle);
+      }
+      SD_xfer_state = SD_XFER_IDLE;
+      SD_BusError(HAL_SD_ERROR_DATA_TIMEOUT);
+      return MSD_ERROR;
+    }
+  }
+  return sd_state;
+}
+#endif /* BSP_SD_ASYNC */
 #else /* STM32L1xx */
 /**
   * @brief  Reads block(s) from a specified address in an SD card, in polling mode.
@@ -432,6 +1124,51 @@ __weak void BSP_SD_MspInit(SD_HandleTypeDef *hsd, void *Params)
   UNUSED(hsd);
   SD_CLK_ENABLE();
 #endif
+
+#if BSP_SD_ASYNC
+  /* NVIC configuration for SD interrupts */
+#if defined(SDMMC1) && defined(SDMMC2)
+  IRQn_Type irq = (hsd->Instance == SDMMC1) ? SD_IRQn : SD2_IRQn;
+#else
+  IRQn_Type irq = SD_IRQn;
+#endif
+  HAL_NVIC_SetPriority(irq, SD_IRQ_PRIO, SD_IRQ_SUBPRIO);
+  HAL_NVIC_EnableIRQ(irq);
+
+#ifdef SD_DMA_RX_STREAM
+  /* Configure the DMA streams */
+  SD_DMA_CLK_ENABLE();
+
+  SD_dma_rx.Instance                 = SD_DMA_RX_STREAM;
+  SD_dma_rx.Init.Channel             = SD_DMA_CHANNEL;
+  SD_dma_rx.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+  SD_dma_rx.Init.PeriphInc           = DMA_PINC_DISABLE;
+  SD_dma_rx.Init.MemInc              = DMA_MINC_ENABLE;
+  SD_dma_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+  SD_dma_rx.Init.MemDataAlignment    = DMA_MDATAALIGN_WORD;
+  SD_dma_rx.Init.Mode                = DMA_PFCTRL;
+  SD_dma_rx.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
+  SD_dma_rx.Init.FIFOMode            = DMA_FIFOMODE_ENABLE;
+  SD_dma_rx.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
+  SD_dma_rx.Init.MemBurst            = DMA_MBURST_INC4;
+  SD_dma_rx.Init.PeriphBurst         = DMA_PBURST_INC4;
+  __HAL_LINKDMA(hsd, hdmarx, SD_dma_rx);
+  HAL_DMA_DeInit(&SD_dma_rx);
+  HAL_DMA_Init(&SD_dma_rx);
+
+  SD_dma_tx.Instance                 = SD_DMA_TX_STREAM;
+  SD_dma_tx.Init                     = SD_dma_rx.Init;
+  SD_dma_tx.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+  __HAL_LINKDMA(hsd, hdmatx, SD_dma_tx);
+  HAL_DMA_DeInit(&SD_dma_tx);
+  HAL_DMA_Init(&SD_dma_tx);
+
+  HAL_NVIC_SetPriority(SD_DMA_RX_IRQn, SD_DMA_IRQ_PRIO, 0);
+  HAL_NVIC_EnableIRQ(SD_DMA_RX_IRQn);
+  HAL_NVIC_SetPriority(SD_DMA_TX_IRQn, SD_DMA_IRQ_PRIO, 0);
+  HAL_NVIC_EnableIRQ(SD_DMA_TX_IRQn);
+#endif /* SD_DMA_RX_STREAM */
+#endif /* BSP_SD_ASYNC */
 }
 
 /**
@@ -477,6 +1214,20 @@ __weak void BSP_SD_MspDeInit(SD_HandleTypeDef *hsd, void *Params)
   UNUSED(hsd);
   SD_CLK_DISABLE();
 #endif
+
+#if BSP_SD_ASYNC
+#if defined(SDMMC1) && defined(SDMMC2)
+  HAL_NVIC_DisableIRQ((hsd->Instance == SDMMC1) ? SD_IRQn : SD2_IRQn);
+#else
+  HAL_NVIC_DisableIRQ(SD_IRQn);
+#endif
+#ifdef SD_DMA_RX_STREAM
+  HAL_NVIC_DisableIRQ(SD_DMA_RX_IRQn);
+  HAL_NVIC_DisableIRQ(SD_DMA_TX_IRQn);
+  HAL_DMA_DeInit(&SD_dma_rx);
+  HAL_DMA_DeInit(&SD_dma_tx);
+#endif
+#endif /* BSP_SD_ASYNC */
 }
 
 #ifdef SDMMC_TRANSCEIVER_ENABLE
@@ -532,6 +1283,23 @@ uint8_t BSP_SD_GetCardState(void)
 {
   return ((HAL_SD_GetCardState(&uSdHandle) == HAL_SD_CARD_TRANSFER) ? SD_TRANSFER_OK : SD_TRANSFER_BUSY);
 }
+
+/**
+  * @brief  Waits for the card to be back in transfer state, e.g. after an erase.
+  * @param  Timeout: Timeout in ms
+  * @retval SD status
+  */
+uint8_t BSP_SD_WaitCardReady(uint32_t Timeout)
+{
+  uint32_t tickstart = HAL_GetTick();
+
+  while (BSP_SD_GetCardState() != SD_TRANSFER_OK) {
+    if ((HAL_GetTick() - tickstart) >= Timeout) {
+      return MSD_ERROR;
+    }
+  }
+  return MSD_OK;
+}
 #else /* STM32L1xx */
 /**
   * @brief  Gets the current SD card data status.
@@ -557,4 +1325,119 @@ void BSP_SD_GetCardInfo(HAL_SD_CardInfoTypeDef *CardInfo)
   HAL_SD_Get_CardInfo(&uSdHandle, CardInfo);
 }
 
+#if BSP_SD_ASYNC
+/**
+  * @brief  Rx Transfer completed callback.
+  * @param  hsd: SD handle
+  */
+void HAL_SD_RxCpltCallback(SD_HandleTypeDef *hsd)
+{
+  UNUSED(hsd);
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+  if ((SD_xfer_dma_rx_buf != NULL) && (SCB->CCR & SCB_CCR_DC_Msk)) {
+    SCB_InvalidateDCache_by_Addr(SD_xfer_dma_rx_buf, (int32_t)SD_xfer_dma_rx_len);
+  }
+  SD_xfer_dma_rx_buf = NULL;
+#endif
+  SD_xfer_state = SD_XFER_DONE;
+  BSP_SD_ReadCpltCallback();
+}
+
+/**
+  * @brief  Tx Transfer completed callback.
+  * @param  hsd: SD handle
+  */
+void HAL_SD_TxCpltCallback(SD_HandleTypeDef *hsd)
+{
+  UNUSED(hsd);
+  SD_xfer_state = SD_XFER_DONE;
+  BSP_SD_WriteCpltCallback();
+}
+
+/**
+  * @brief  SD error callback.
+  * @param  hsd: SD handle
+  */
+void HAL_SD_ErrorCallback(SD_HandleTypeDef *hsd)
+{
+  UNUSED(hsd);
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U)
+  SD_xfer_dma_rx_buf = NULL;
+#endif
+  SD_xfer_state = SD_XFER_ERROR;
+  BSP_SD_ErrorCallback();
+}
+
+/**
+  * @brief  SD abort callback.
+  * @param  hsd: SD handle
+  */
+void HAL_SD_AbortCallback(SD_HandleTypeDef *hsd)
+{
+  UNUSED(hsd);
+  SD_xfer_state = SD_XFER_ERROR;
+}
+
+/**
+  * @brief  BSP SD Rx transfer completed callback, called under interrupt.
+  */
+__weak void BSP_SD_ReadCpltCallback(void)
+{
+}
+
+/**
+  * @brief  BSP SD Tx transfer completed callback, called under interrupt.
+  */
+__weak void BSP_SD_WriteCpltCallback(void)
+{
+}
+
+/**
+  * @brief  BSP SD error callback, called under interrupt.
+  */
+__weak void BSP_SD_ErrorCallback(void)
+{
+}
+
+/**
+  * @brief  SD interrupt handlers.
+  */
+#if defined(SDMMC1) || defined(SDMMC2)
+#ifdef SDMMC1
+void SDMMC1_IRQHandler(void)
+{
+  HAL_SD_IRQHandler(&uSdHandle);
+}
+#endif
+#ifdef SDMMC2
+void SDMMC2_IRQHandler(void)
+{
+  HAL_SD_IRQHandler(&uSdHandle);
+}
+#endif
+#else
+void SDIO_IRQHandler(void)
+{
+  HAL_SD_IRQHandler(&uSdHandle);
+}
+#endif
+
+#ifdef SD_DMA_RX_STREAM
+/**
+  * @brief  SD DMA interrupt handlers.
+  */
+void SD_DMA_RX_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(uSdHandle.hdmarx);
+}
+
+void SD_DMA_TX_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(uSdHandle.hdmatx);
+}
+#endif
+#endif /* BSP_SD_ASYNC */
+
+#endif /* !SD_HOST_EMULATION */
+
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -44,6 +44,9 @@ extern "C" {
 #endif
 
 /* Includes ------------------------------------------------------------------*/
+#ifdef SD_HOST_EMULATION
+#include "bsp_sd_host.h"
+#else
 #include "stm32_def.h"
 #if !defined(STM32_CORE_VERSION) || (STM32_CORE_VERSION  <= 0x01050000)
 #include "variant.h"
@@ -52,6 +55,7 @@ extern "C" {
 #error "This library version required a STM32 core version > 1.6.1.\
 Please update the core or install previous libray version."
 #endif
+#endif /* SD_HOST_EMULATION */
 
 /*SD Card information structure */
 #ifndef STM32L1xx
@@ -63,10 +67,19 @@ Please update the core or install previous libray version."
 
 #define SD_CardInfo HAL_SD_CardInfoTypedef
 
+/* Raw card registers, big-endian words (word 0 holds the most significant bits) */
+typedef struct {
+  uint32_t CID[4];   /*!< Card identification                           */
+  uint32_t CSD[4];   /*!< Card specific data                            */
+  uint32_t SCR[2];   /*!< SD configuration register                     */
+  uint32_t SSR[16];  /*!< SD status (ACMD13)                            */
+} BSP_SD_CardRegisters;
+
 /*SD status structure definition */
 #define MSD_OK                   ((uint8_t)0x00)
 #define MSD_ERROR                ((uint8_t)0x01)
 #define MSD_ERROR_SD_NOT_PRESENT ((uint8_t)0x02)
+#define MSD_BUSY                 ((uint8_t)0x03)
 
 /* SD Exported Constants */
 #define SD_PRESENT               ((uint8_t)0x01)
@@ -81,6 +94,47 @@ Please update the core or install previous libray version."
 #define SD_DATATIMEOUT         100000000U
 #endif
 
+/* Send ACMD23 before multi-block writes of at least SD_PRE_ERASE_MIN_BLOCKS
+   blocks (could be changed at runtime with BSP_SD_SetPreErase()) */
+#ifndef SD_PRE_ERASE
+#define SD_PRE_ERASE             0
+#endif
+#ifndef SD_PRE_ERASE_MIN_BLOCKS
+#define SD_PRE_ERASE_MIN_BLOCKS  2
+#endif
+
+/* SD bus speed modes */
+#define SD_SPEED_DEFAULT         0  /* Default speed, up to 25 MHz   */
+#define SD_SPEED_HIGH            1  /* High speed, up to 50 MHz      */
+#define SD_SPEED_UHS             2  /* UHS-I, requires a transceiver */
+
+/* Bus speed mode selected at init if supported by the card (could be changed
+   at runtime with BSP_SD_SetBusSpeed()) */
+#ifndef SD_BUS_SPEED
+#define SD_BUS_SPEED             SD_SPEED_DEFAULT
+#endif
+/* Number of CRC/timeout errors before slowing the bus clock down, 0 disables */
+#ifndef SD_CLK_FALLBACK_ERRORS
+#define SD_CLK_FALLBACK_ERRORS   3
+#endif
+
+/* SD transfer modes */
+#define SD_MODE_POLLING          0
+#define SD_MODE_IT               1
+#define SD_MODE_DMA              2
+
+/* Could be redefined in variant.h or using build_opt.h */
+#ifndef SD_TRANSFER_MODE
+#define SD_TRANSFER_MODE       SD_MODE_POLLING
+#endif
+
+/* Non-blocking transfer API (BSP_SD_Start*Blocks, BSP_SD_PollTransfer,...) availability */
+#if defined(SD_HOST_EMULATION) || ((SD_TRANSFER_MODE != SD_MODE_POLLING) && !defined(STM32L1xx))
+#define BSP_SD_ASYNC             1
+#else
+#define BSP_SD_ASYNC             0
+#endif
+
 #ifdef SDMMC_TRANSCEIVER_ENABLE
 #ifndef SD_TRANSCEIVER_EN
 #define SD_TRANSCEIVER_EN      SD_TRANSCEIVER_NONE
@@ -106,9 +160,27 @@ uint8_t BSP_SD_WriteBlocks(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBl
 uint8_t BSP_SD_ReadBlocks(uint32_t *pData, uint64_t ReadAddr, uint32_t BlockSize, uint32_t NumOfBlocks);
 uint8_t BSP_SD_WriteBlocks(uint32_t *pData, uint64_t WriteAddr, uint32_t BlockSize, uint32_t NumOfBlocks);
 #endif
+#if BSP_SD_ASYNC
+uint8_t BSP_SD_ReadBlocks_IT(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks);
+uint8_t BSP_SD_WriteBlocks_IT(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks);
+uint8_t BSP_SD_ReadBlocks_DMA(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks);
+uint8_t BSP_SD_WriteBlocks_DMA(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks);
+uint8_t BSP_SD_StartReadBlocks(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks);
+uint8_t BSP_SD_StartWriteBlocks(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks);
+uint8_t BSP_SD_PollTransfer(void);
+uint8_t BSP_SD_WaitTransfer(uint32_t Timeout);
+#endif
 uint8_t BSP_SD_Erase(uint64_t StartAddr, uint64_t EndAddr);
 #ifndef STM32L1xx
+void    BSP_SD_SetPreErase(uint8_t Enable);
+uint8_t BSP_SD_SetBusSpeed(uint8_t Speed);
+uint8_t BSP_SD_GetBusSpeed(void);
+uint8_t BSP_SD_SetClockDiv(uint32_t ClockDiv);
+uint32_t BSP_SD_GetClockDiv(void);
+uint32_t BSP_SD_GetClockFallbacks(void);
+uint8_t BSP_SD_GetCardRegisters(BSP_SD_CardRegisters *Regs);
 uint8_t BSP_SD_GetCardState(void);
+uint8_t BSP_SD_WaitCardReady(uint32_t Timeout);
 #else /* STM32L1xx */
 HAL_SD_TransferStateTypedef BSP_SD_GetStatus(void);
 #endif
@@ -123,6 +195,11 @@ void    BSP_SD_MspDeInit(SD_HandleTypeDef *hsd, void *Params);
 #ifdef SDMMC_TRANSCEIVER_ENABLE
 void    BSP_SD_Transceiver_MspInit(SD_HandleTypeDef *hsd, void *Params);
 #endif
+#if BSP_SD_ASYNC
+void    BSP_SD_ReadCpltCallback(void);
+void    BSP_SD_WriteCpltCallback(void);
+void    BSP_SD_ErrorCallback(void);
+#endif
 
 #ifdef __cplusplus
 }
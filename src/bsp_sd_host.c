@@ -0,0 +1,802 @@
+/**
+******************************************************************************
+* @file    bsp_sd_host.c
+* @brief   This file includes the host (PC) emulation of the uSD card driver.
+*          The card is emulated over a RAM or file backed disk image with a
+*          configurable latency/bandwidth model, so the upper layers (FatFs,
+*          Sd2Card, SdFatFs, SDClass and File) can be profiled on a host.
+*          Only built when SD_HOST_EMULATION is defined.
+******************************************************************************
+* @attention
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*   1. Redistributions of source code must retain the above copyright notice,
+*      this list of conditions and the following disclaimer.
+*   2. Redistributions in binary form must reproduce the above copyright notice,
+*      this list of conditions and the following disclaimer in the documentation
+*      and/or other materials provided with the distribution.
+*   3. Neither the name of STMicroelectronics nor the names of its contributors
+*      may be used to endorse or promote products derived from this software
+*      without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+******************************************************************************
+*/
+
+#ifdef SD_HOST_EMULATION
+#define _POSIX_C_SOURCE 200809L
+
+/* Includes ------------------------------------------------------------------*/
+#include "bsp_sd.h"
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SD_TRANSFER_OK                ((uint8_t)0x00)
+#define SD_TRANSFER_BUSY              ((uint8_t)0x01)
+
+/* Above 2GB the emulated card reports itself as SDHC */
+#define SD_HOST_SDSC_MAX_BLOCKS       (4194304U)
+
+/* BSP SD Private Variables */
+static uint8_t *host_image = NULL;
+static int host_fd = -1;
+static uint32_t host_blocks = 0;
+static uint8_t host_initialized = 0;
+static BSP_SD_HostTiming host_timing = { 0 };
+static BSP_SD_HostStats host_stats = { 0 };
+static uint64_t host_virtual_us = 0;
+static uint64_t host_busy_until = 0;
+static void (*host_trace)(char op, uint32_t addr, uint32_t NumOfBlocks) = NULL;
+/* Non-blocking transfer in progress */
+static uint8_t host_xfer_busy = 0;
+static uint8_t host_xfer_write = 0;
+static uint64_t host_xfer_until = 0;
+static uint64_t host_xfer_cost = 0;
+static uint8_t host_pre_erase = SD_PRE_ERASE;
+static uint8_t host_bus_speed = SD_SPEED_DEFAULT;
+static uint32_t host_clock_div = 0;
+
+/**
+  * @brief  Current time of the emulated card, in microseconds.
+  * @retval Wall clock in real time mode else the modelled clock
+  */
+static uint64_t host_now(void)
+{
+  if (host_timing.RealTime) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000U) + ((uint64_t)ts.tv_nsec / 1000U);
+  }
+  return host_virtual_us;
+}
+
+/**
+  * @brief  Account (and optionally sleep) the modelled cost of an operation.
+  * @param  us: cost in microseconds
+  */
+static void host_spend(uint64_t us)
+{
+  host_stats.ElapsedUs += us;
+  if (host_timing.RealTime) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(us / 1000000U);
+    ts.tv_nsec = (long)((us % 1000000U) * 1000U);
+    while (nanosleep(&ts, &ts) != 0) {
+    }
+  } else {
+    host_virtual_us += us;
+  }
+}
+
+/**
+  * @brief  Wait until the end of a pending write busy phase before a new command.
+  */
+static void host_wait_busy(void)
+{
+  uint64_t now = host_now();
+  if (now < host_busy_until) {
+    host_spend(host_busy_until - now);
+  }
+}
+
+/**
+  * @brief  Account the pre-erase command (ACMD23) sent before a multi-block write.
+  * @param  NumOfBlocks: Number of SD blocks of the write
+  */
+static void host_pre_erase_cmd(uint32_t NumOfBlocks)
+{
+  if (host_pre_erase && (NumOfBlocks >= SD_PRE_ERASE_MIN_BLOCKS)) {
+    host_stats.PreEraseCmds++;
+    host_spend(host_timing.CmdOverheadUs);
+  }
+}
+
+/**
+  * @brief  Check that an access is inside the attached disk image.
+  * @retval 1 if valid else 0
+  */
+static uint8_t host_check_range(uint32_t addr, uint32_t NumOfBlocks)
+{
+  return (host_initialized && (NumOfBlocks != 0) && (addr < host_blocks) &&
+          (NumOfBlocks <= (host_blocks - addr)));
+}
+
+/**
+  * @brief  Attach a RAM disk image to the emulated card.
+  * @param  image: buffer of NumOfBlocks * 512 bytes
+  * @param  NumOfBlocks: image size in blocks
+  * @retval SD status
+  */
+uint8_t BSP_SD_HostAttachRam(uint8_t *image, uint32_t NumOfBlocks)
+{
+  if ((image == NULL) || (NumOfBlocks == 0)) {
+    return MSD_ERROR;
+  }
+  BSP_SD_HostDetach();
+  host_image = image;
+  host_blocks = NumOfBlocks;
+  return MSD_OK;
+}
+
+/**
+  * @brief  Attach a disk image file to the emulated card. The file is created
+  *         or extended to NumOfBlocks * 512 bytes if needed.
+  * @param  path: disk image file path
+  * @param  NumOfBlocks: image size in blocks
+  * @retval SD status
+  */
+uint8_t BSP_SD_HostAttachFile(const char *path, uint32_t NumOfBlocks)
+{
+  int fd;
+  off_t size;
+
+  if ((path == NULL) || (NumOfBlocks == 0)) {
+    return MSD_ERROR;
+  }
+  fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return MSD_ERROR;
+  }
+  size = (off_t)NumOfBlocks * SD_HOST_BLOCK_SIZE;
+  if ((lseek(fd, 0, SEEK_END) < size) && (ftruncate(fd, size) != 0)) {
+    close(fd);
+    return MSD_ERROR;
+  }
+  BSP_SD_HostDetach();
+  host_fd = fd;
+  host_blocks = NumOfBlocks;
+  return MSD_OK;
+}
+
+/**
+  * @brief  Detach the current disk image, if any.
+  */
+void BSP_SD_HostDetach(void)
+{
+  if (host_fd >= 0) {
+    close(host_fd);
+    host_fd = -1;
+  }
+  host_image = NULL;
+  host_blocks = 0;
+  host_initialized = 0;
+}
+
+/**
+  * @brief  Set the latency/bandwidth model of the emulated card.
+  * @param  timing: Pointer to the timing model, NULL for an infinitely fast card
+  */
+void BSP_SD_HostSetTiming(const BSP_SD_HostTiming *timing)
+{
+  if (timing != NULL) {
+    host_timing = *timing;
+  } else {
+    memset(&host_timing, 0, sizeof(host_timing));
+  }
+  host_busy_until = 0;
+}
+
+/**
+  * @brief  Get the statistics of the emulated card traffic.
+  * @param  stats: Pointer to the statistics structure to fill
+  */
+void BSP_SD_HostGetStats(BSP_SD_HostStats *stats)
+{
+  if (stats != NULL) {
+    *stats = host_stats;
+  }
+}
+
+/**
+  * @brief  Reset the statistics of the emulated card traffic.
+  */
+void BSP_SD_HostResetStats(void)
+{
+  memset(&host_stats, 0, sizeof(host_stats));
+}
+
+/**
+  * @brief  Register a callback called for each command reaching the emulated card.
+  * @param  callback: trace function, NULL to disable the trace
+  */
+void BSP_SD_HostSetTrace(void (*callback)(char op, uint32_t addr, uint32_t NumOfBlocks))
+{
+  host_trace = callback;
+}
+
+/**
+  * @brief  Initializes the emulated SD card.
+  * @retval SD status
+  */
+uint8_t BSP_SD_Init(void)
+{
+  if ((host_image == NULL) && (host_fd < 0)) {
+    return MSD_ERROR_SD_NOT_PRESENT;
+  }
+  host_initialized = 1;
+  host_busy_until = 0;
+  host_bus_speed = SD_SPEED_DEFAULT;
+  (void)BSP_SD_SetBusSpeed(SD_BUS_SPEED);
+  return MSD_OK;
+}
+
+/**
+  * @brief  DeInitializes the emulated SD card.
+  * @retval SD status
+  */
+uint8_t BSP_SD_DeInit(void)
+{
+  host_initialized = 0;
+  return MSD_OK;
+}
+
+/**
+  * @brief  No detect pin on the emulated card.
+  * @retval SD status
+  */
+uint8_t BSP_SD_DetectPin(GPIO_TypeDef *port, uint32_t pin)
+{
+  UNUSED(port);
+  UNUSED(pin);
+  return MSD_OK;
+}
+
+/**
+  * @brief  No detect pin on the emulated card.
+  * @retval SD status
+  */
+uint8_t BSP_SD_DetectITConfig(void (*callback)(void))
+{
+  UNUSED(callback);
+  return MSD_ERROR;
+}
+
+/**
+ * @brief  The emulated card is present as soon as an image is attached.
+ * @retval Returns if SD is detected or not
+ */
+uint8_t BSP_SD_IsDetected(void)
+{
+  return ((host_image != NULL) || (host_fd >= 0)) ? SD_PRESENT : SD_NOT_PRESENT;
+}
+
+/**
+  * @brief  Reads block(s) from a specified address in the disk image.
+  * @param  pData: Pointer to the buffer that will contain the data to transmit
+  * @param  ReadAddr: Block address from where data is to be read
+  * @param  NumOfBlocks: Number of SD blocks to read
+  * @param  Timeout: Timeout in ms to wait for a pending non-blocking transfer
+  * @retval SD status
+  */
+uint8_t BSP_SD_ReadBlocks(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks, uint32_t Timeout)
+{
+  size_t len = (size_t)NumOfBlocks * SD_HOST_BLOCK_SIZE;
+  if (host_xfer_busy) {
+    (void)BSP_SD_WaitTransfer(Timeout);
+  }
+  if (!host_check_range(ReadAddr, NumOfBlocks)) {
+    return MSD_ERROR;
+  }
+  host_wait_busy();
+  if (host_image != NULL) {
+    memcpy(pData, &host_image[(size_t)ReadAddr * SD_HOST_BLOCK_SIZE], len);
+  } else if (pread(host_fd, pData, len, (off_t)ReadAddr * SD_HOST_BLOCK_SIZE) != (ssize_t)len) {
+    return MSD_ERROR;
+  }
+  host_stats.ReadCmds++;
+  host_stats.BlocksRead += NumOfBlocks;
+  host_spend(host_timing.CmdOverheadUs + ((uint64_t)host_timing.ReadBlockUs * NumOfBlocks));
+  if (host_trace != NULL) {
+    host_trace(SD_HOST_TRACE_READ, ReadAddr, NumOfBlocks);
+  }
+  return MSD_OK;
+}
+
+/**
+  * @brief  Writes block(s) to a specified address in the disk image.
+  *         The card stays busy for WriteBusyUs after the transfer.
+  * @param  pData: Pointer to the buffer that will contain the data to transmit
+  * @param  WriteAddr: Block address from where data is to be written
+  * @param  NumOfBlocks: Number of SD blocks to write
+  * @param  Timeout: Timeout in ms to wait for a pending non-blocking transfer
+  * @retval SD status
+  */
+uint8_t BSP_SD_WriteBlocks(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks, uint32_t Timeout)
+{
+  size_t len = (size_t)NumOfBlocks * SD_HOST_BLOCK_SIZE;
+  if (host_xfer_busy) {
+    (void)BSP_SD_WaitTransfer(Timeout);
+  }
+  if (!host_check_range(WriteAddr, NumOfBlocks)) {
+    return MSD_ERROR;
+  }
+  host_wait_busy();
+  host_pre_erase_cmd(NumOfBlocks);
+  if (host_image != NULL) {
+    memcpy(&host_image[(size_t)WriteAddr * SD_HOST_BLOCK_SIZE], pData, len);
+  } else if (pwrite(host_fd, pData, len, (off_t)WriteAddr * SD_HOST_BLOCK_SIZE) != (ssize_t)len) {
+    return MSD_ERROR;
+  }
+  host_stats.WriteCmds++;
+  host_stats.BlocksWritten += NumOfBlocks;
+  host_spend(host_timing.CmdOverheadUs + ((uint64_t)host_timing.WriteBlockUs * NumOfBlocks));
+  host_busy_until = host_now() + host_timing.WriteBusyUs;
+  if (host_trace != NULL) {
+    host_trace(SD_HOST_TRACE_WRITE, WriteAddr, NumOfBlocks);
+  }
+  return MSD_OK;
+}
+
+/**
+  * @brief  Starts a non-blocking transfer. The data is copied at once, the
+  *         transfer completes when its modelled duration has elapsed.
+  * @param  pData: Pointer to the buffer
+  * @param  Addr: Block address
+  * @param  NumOfBlocks: Number of SD blocks
+  * @param  write: 1 to write to the image, 0 to read from it
+  * @retval SD status
+  */
+static uint8_t host_xfer_start(uint32_t *pData, uint32_t Addr, uint32_t NumOfBlocks, uint8_t write)
+{
+  size_t len = (size_t)NumOfBlocks * SD_HOST_BLOCK_SIZE;
+  off_t offset = (off_t)Addr * SD_HOST_BLOCK_SIZE;
+
+  if (host_xfer_busy) {
+    return MSD_BUSY;
+  }
+  if (!host_check_range(Addr, NumOfBlocks)) {
+    return MSD_ERROR;
+  }
+  host_wait_busy();
+  if (write) {
+    host_pre_erase_cmd(NumOfBlocks);
+    if (host_image != NULL) {
+      memcpy(&host_image[offset], pData, len);
+    } else if (pwrite(host_fd, pData, len, offset) != (ssize_t)len) {
+      return MSD_ERROR;
+    }
+    host_stats.WriteCmds++;
+    host_stats.BlocksWritten += NumOfBlocks;
+    host_xfer_cost = host_timing.CmdOverheadUs + ((uint64_t)host_timing.WriteBlockUs * NumOfBlocks);
+  } else {
+    if (host_image != NULL) {
+      memcpy(pData, &host_image[offset], len);
+    } else if (pread(host_fd, pData, len, offset) != (ssize_t)len) {
+      return MSD_ERROR;
+    }
+    host_stats.ReadCmds++;
+    host_stats.BlocksRead += NumOfBlocks;
+    host_xfer_cost = host_timing.CmdOverheadUs + ((uint64_t)host_timing.ReadBlockUs * NumOfBlocks);
+  }
+  if (host_trace != NULL) {
+    host_trace(write ? SD_HOST_TRACE_WRITE : SD_HOST_TRACE_READ, Addr, NumOfBlocks);
+  }
+  host_xfer_write = write;
+  host_xfer_until = host_now() + host_xfer_cost;
+  host_xfer_busy = 1;
+  return MSD_OK;
+}
+
+/**
+  * @brief  Starts reading block(s) from the disk image, in interrupt mode.
+  * @param  pData: Pointer to the buffer that will contain the data to transmit
+  * @param  ReadAddr: Block address from where data is to be read
+  * @param  NumOfBlocks: Number of SD blocks to read
+  * @retval SD status
+  */
+uint8_t BSP_SD_ReadBlocks_IT(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks)
+{
+  return host_xfer_start(pData, ReadAddr, NumOfBlocks, 0);
+}
+
+/**
+  * @brief  Starts writing block(s) to the disk image, in interrupt mode.
+  * @param  pData: Pointer to the buffer that will contain the data to transmit
+  * @param  WriteAddr: Block address from where data is to be written
+  * @param  NumOfBlocks: Number of SD blocks to write
+  * @retval SD status
+  */
+uint8_t BSP_SD_WriteBlocks_IT(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks)
+{
+  return host_xfer_start(pData, WriteAddr, NumOfBlocks, 1);
+}
+
+/**
+  * @brief  Starts reading block(s) from the disk image, in DMA mode.
+  *         As on target, the buffer must be word aligned.
+  * @param  pData: Pointer to the buffer that will contain the data to transmit
+  * @param  ReadAddr: Block address from where data is to be read
+  * @param  NumOfBlocks: Number of SD blocks to read
+  * @retval SD status
+  */
+uint8_t BSP_SD_ReadBlocks_DMA(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks)
+{
+  if (((uintptr_t)pData & 0x3U) != 0) {
+    return MSD_ERROR;
+  }
+  return host_xfer_start(pData, ReadAddr, NumOfBlocks, 0);
+}
+
+/**
+  * @brief  Starts writing block(s) to the disk image, in DMA mode.
+  *         As on target, the buffer must be word aligned.
+  * @param  pData: Pointer to the buffer that will contain the data to transmit
+  * @param  WriteAddr: Block address from where data is to be written
+  * @param  NumOfBlocks: Number of SD blocks to write
+  * @retval SD status
+  */
+uint8_t BSP_SD_WriteBlocks_DMA(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks)
+{
+  if (((uintptr_t)pData & 0x3U) != 0) {
+    return MSD_ERROR;
+  }
+  return host_xfer_start(pData, WriteAddr, NumOfBlocks, 1);
+}
+
+/**
+  * @brief  Starts reading block(s) from the disk image.
+  * @param  pData: Pointer to the buffer that will contain the data to transmit
+  * @param  ReadAddr: Block address from where data is to be read
+  * @param  NumOfBlocks: Number of SD blocks to read
+  * @retval SD status
+  */
+uint8_t BSP_SD_StartReadBlocks(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks)
+{
+  return host_xfer_start(pData, ReadAddr, NumOfBlocks, 0);
+}
+
+/**
+  * @brief  Starts writing block(s) to the disk image.
+  * @param  pData: Pointer to the buffer that will contain the data to transmit
+  * @param  WriteAddr: Block address from where data is to be written
+  * @param  NumOfBlocks: Number of SD blocks to write
+  * @retval SD status
+  */
+uint8_t BSP_SD_StartWriteBlocks(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks)
+{
+  return host_xfer_start(pData, WriteAddr, NumOfBlocks, 1);
+}
+
+/**
+  * @brief  Gets the status of the last started transfer, including the card
+  *         busy phase of a write. The completion callbacks are called from here.
+  *         In modelled time mode, a transfer in progress reports MSD_BUSY once
+  *         and the modelled clock jumps to its end.
+  * @retval MSD_OK: transfer done and card ready, MSD_BUSY: in progress
+  */
+uint8_t BSP_SD_PollTransfer(void)
+{
+  if (host_xfer_busy) {
+    uint64_t now = host_now();
+    if (now < host_xfer_until) {
+      host_stats.BusyPolls++;
+      if (!host_timing.RealTime) {
+        host_virtual_us = host_xfer_until;
+      }
+      return MSD_BUSY;
+    }
+    host_stats.ElapsedUs += host_xfer_cost;
+    host_xfer_busy = 0;
+    if (host_xfer_write) {
+      host_busy_until = host_xfer_until + host_timing.WriteBusyUs;
+      BSP_SD_WriteCpltCallback();
+    } else {
+      BSP_SD_ReadCpltCallback();
+    }
+  }
+  if (BSP_SD_GetCardState() != SD_TRANSFER_OK) {
+    return MSD_BUSY;
+  }
+  return MSD_OK;
+}
+
+/**
+  * @brief  Waits for the end of the last started transfer.
+  * @param  Timeout: Timeout in ms
+  * @retval SD status
+  */
+uint8_t BSP_SD_WaitTransfer(uint32_t Timeout)
+{
+  uint64_t start = host_now();
+  uint8_t sd_state;
+
+  while ((sd_state = BSP_SD_PollTransfer()) == MSD_BUSY) {
+    if ((host_now() - start) >= ((uint64_t)Timeout * 1000U)) {
+      return MSD_ERROR;
+    }
+  }
+  return sd_state;
+}
+
+/**
+  * @brief  BSP SD Rx transfer completed callback.
+  */
+__weak void BSP_SD_ReadCpltCallback(void)
+{
+}
+
+/**
+  * @brief  BSP SD Tx transfer completed callback.
+  */
+__weak void BSP_SD_WriteCpltCallback(void)
+{
+}
+
+/**
+  * @brief  BSP SD error callback.
+  */
+__weak void BSP_SD_ErrorCallback(void)
+{
+}
+
+/**
+  * @brief  Erases the specified memory area of the disk image (filled with 0xFF).
+  * @param  StartAddr: Start block address
+  * @param  EndAddr: End block address (included)
+  * @retval SD status
+  */
+uint8_t BSP_SD_Erase(uint64_t StartAddr, uint64_t EndAddr)
+{
+  uint8_t erased[SD_HOST_BLOCK_SIZE];
+  uint32_t NumOfBlocks;
+  uint32_t i;
+
+  if ((EndAddr < StartAddr) || (EndAddr >= host_blocks) ||
+      !host_check_range((uint32_t)StartAddr, (uint32_t)(EndAddr - StartAddr + 1))) {
+    return MSD_ERROR;
+  }
+  NumOfBlocks = (uint32_t)(EndAddr - StartAddr + 1);
+  host_wait_busy();
+  memset(erased, 0xFF, sizeof(erased));
+  for (i = 0; i < NumOfBlocks; i++) {
+    off_t offset = (off_t)(StartAddr + i) * SD_HOST_BLOCK_SIZE;
+    if (host_image != NULL) {
+      memcpy(&host_image[offset], erased, sizeof(erased));
+    } else if (pwrite(host_fd, erased, sizeof(erased), offset) != (ssize_t)sizeof(erased)) {
+      return MSD_ERROR;
+    }
+  }
+  host_stats.EraseCmds++;
+  host_stats.BlocksErased += NumOfBlocks;
+  host_spend(host_timing.CmdOverheadUs + ((uint64_t)host_timing.EraseBlockUs * NumOfBlocks));
+  if (host_trace != NULL) {
+    host_trace(SD_HOST_TRACE_ERASE, (uint32_t)StartAddr, NumOfBlocks);
+  }
+  return MSD_OK;
+}
+
+/**
+  * @brief  Enables or disables the pre-erase (ACMD23) before multi-block writes.
+  * @param  Enable: 1 to enable, 0 to disable
+  */
+void BSP_SD_SetPreErase(uint8_t Enable)
+{
+  host_pre_erase = Enable;
+}
+
+/**
+  * @brief  Switches the bus speed mode of the emulated card.
+  *         UHS-I is not emulated.
+  * @param  Speed: SD_SPEED_DEFAULT or SD_SPEED_HIGH
+  * @retval SD status
+  */
+uint8_t BSP_SD_SetBusSpeed(uint8_t Speed)
+{
+  if (host_xfer_busy) {
+    return MSD_BUSY;
+  }
+  if ((Speed != SD_SPEED_DEFAULT) && (Speed != SD_SPEED_HIGH)) {
+    return MSD_ERROR;
+  }
+  host_bus_speed = Speed;
+  return MSD_OK;
+}
+
+/**
+  * @brief  Gets the bus speed mode of the emulated card.
+  * @retval SD_SPEED_DEFAULT or SD_SPEED_HIGH
+  */
+uint8_t BSP_SD_GetBusSpeed(void)
+{
+  return host_bus_speed;
+}
+
+/**
+  * @brief  Sets the bus clock divider, only recorded: the timing model is
+  *         set by BSP_SD_HostSetTiming().
+  * @param  ClockDiv: clock divider
+  * @retval SD status
+  */
+uint8_t BSP_SD_SetClockDiv(uint32_t ClockDiv)
+{
+  if (host_xfer_busy) {
+    return MSD_BUSY;
+  }
+  host_clock_div = ClockDiv;
+  return MSD_OK;
+}
+
+/**
+  * @brief  Gets the bus clock divider.
+  * @retval clock divider
+  */
+uint32_t BSP_SD_GetClockDiv(void)
+{
+  return host_clock_div;
+}
+
+/**
+  * @brief  Gets the number of automatic clock slowdowns, the emulated card
+  *         has no bus errors.
+  * @retval 0
+  */
+uint32_t BSP_SD_GetClockFallbacks(void)
+{
+  return 0;
+}
+
+/**
+  * @brief  Sets a bit field of a big-endian register.
+  * @param  reg: register words
+  * @param  bits: register size in bits
+  * @param  msb: most significant bit of the field
+  * @param  lsb: least significant bit of the field
+  * @param  value: field value
+  */
+static void host_set_bits(uint32_t *reg, uint32_t bits, uint32_t msb, uint32_t lsb, uint32_t value)
+{
+  uint32_t bit;
+  for (bit = lsb; bit <= msb; bit++, value >>= 1) {
+    uint32_t word = (bits - 1U - bit) / 32U;
+    if (value & 1U) {
+      reg[word] |= (1UL << (bit % 32U));
+    }
+  }
+}
+
+/**
+  * @brief  Gets the registers of the emulated card: a class 10, U1, V10
+  *         card with 4MB allocation units.
+  * @param  Regs: Pointer to the registers structure
+  * @retval SD status
+  */
+uint8_t BSP_SD_GetCardRegisters(BSP_SD_CardRegisters *Regs)
+{
+  const char *pnm = "HOSTE";
+  uint32_t c_size = (host_blocks >= 1024U) ? ((host_blocks / 1024U) - 1U) : 0U;
+  uint32_t i;
+
+  if (!host_initialized) {
+    return MSD_ERROR;
+  }
+  memset(Regs, 0, sizeof(*Regs));
+  /* CID: OEM "SH", product "HOSTE", rev 1.0, manufactured 01/2024 */
+  host_set_bits(Regs->CID, 128, 119, 104, ('S' << 8) | 'H');
+  for (i = 0; i < 5U; i++) {
+    host_set_bits(Regs->CID, 128, 103 - (8 * i), 96 - (8 * i), (uint8_t)pnm[i]);
+  }
+  host_set_bits(Regs->CID, 128, 63, 56, 0x10);
+  host_set_bits(Regs->CID, 128, 55, 24, 0x12345678);
+  host_set_bits(Regs->CID, 128, 19, 12, 24);
+  host_set_bits(Regs->CID, 128, 11, 8, 1);
+  /* CSD: 25 MHz, capacity in units of 512KB (version 1 with READ_BL_LEN 10 below 2GB) */
+  host_set_bits(Regs->CSD, 128, 103, 96, 0x32);
+  host_set_bits(Regs->CSD, 128, 95, 84, 0x5B5);
+  if (host_blocks > SD_HOST_SDSC_MAX_BLOCKS) {
+    host_set_bits(Regs->CSD, 128, 127, 126, 1);
+    host_set_bits(Regs->CSD, 128, 83, 80, 9);
+    host_set_bits(Regs->CSD, 128, 69, 48, c_size);
+  } else {
+    host_set_bits(Regs->CSD, 128, 83, 80, 10);
+    host_set_bits(Regs->CSD, 128, 73, 62, c_size);
+    host_set_bits(Regs->CSD, 128, 49, 47, 7);
+  }
+  /* SCR: SD 3.0, erased data is 1, 1 and 4 bits bus, CMD23 */
+  host_set_bits(Regs->SCR, 64, 59, 56, 2);
+  host_set_bits(Regs->SCR, 64, 55, 55, 1);
+  host_set_bits(Regs->SCR, 64, 51, 48, 0x5);
+  host_set_bits(Regs->SCR, 64, 47, 47, 1);
+  host_set_bits(Regs->SCR, 64, 35, 32, 0x2);
+  /* SD status */
+  host_set_bits(Regs->SSR, 512, 511, 510, 2);
+  host_set_bits(Regs->SSR, 512, 447, 440, 4);
+  host_set_bits(Regs->SSR, 512, 431, 428, 9);
+  host_set_bits(Regs->SSR, 512, 423, 408, 1);
+  host_set_bits(Regs->SSR, 512, 407, 402, 1);
+  host_set_bits(Regs->SSR, 512, 401, 400, 1);
+  host_set_bits(Regs->SSR, 512, 399, 396, 1);
+  host_set_bits(Regs->SSR, 512, 395, 392, 9);
+  host_set_bits(Regs->SSR, 512, 391, 384, 10);
+  return MSD_OK;
+}
+
+/**
+  * @brief  Gets the current emulated card data status.
+  *         In modelled time mode, a busy card reports SD_TRANSFER_BUSY once
+  *         and the modelled clock jumps to the end of the busy phase.
+  * @retval Data transfer state.
+  *          This value can be one of the following values:
+  *            @arg  SD_TRANSFER_OK: No data transfer is acting
+  *            @arg  SD_TRANSFER_BUSY: Data transfer is acting
+  */
+uint8_t BSP_SD_GetCardState(void)
+{
+  uint64_t now = host_now();
+  if (now < host_busy_until) {
+    host_stats.BusyPolls++;
+    if (!host_timing.RealTime) {
+      host_spend(host_busy_until - now);
+    }
+    return SD_TRANSFER_BUSY;
+  }
+  return SD_TRANSFER_OK;
+}
+
+/**
+  * @brief  Waits for the emulated card to be back in transfer state.
+  * @param  Timeout: Timeout in ms
+  * @retval SD status
+  */
+uint8_t BSP_SD_WaitCardReady(uint32_t Timeout)
+{
+  uint64_t start = host_now();
+
+  while (BSP_SD_GetCardState() != SD_TRANSFER_OK) {
+    if ((host_now() - start) >= ((uint64_t)Timeout * 1000U)) {
+      return MSD_ERROR;
+    }
+  }
+  return MSD_OK;
+}
+
+/**
+  * @brief  Get SD information about the emulated card.
+  * @param  CardInfo: Pointer to HAL_SD_CardInfoTypedef structure
+  */
+void BSP_SD_GetCardInfo(HAL_SD_CardInfoTypeDef *CardInfo)
+{
+  memset(CardInfo, 0, sizeof(*CardInfo));
+  CardInfo->CardType = (host_blocks > SD_HOST_SDSC_MAX_BLOCKS) ? CARD_SDHC_SDXC : CARD_SDSC;
+  CardInfo->CardVersion = CARD_V2_X;
+  CardInfo->Class = 0x5B5;
+  CardInfo->RelCardAdd = 1;
+  CardInfo->BlockNbr = host_blocks;
+  CardInfo->BlockSize = SD_HOST_BLOCK_SIZE;
+  CardInfo->LogBlockNbr = host_blocks;
+  CardInfo->LogBlockSize = SD_HOST_BLOCK_SIZE;
+}
+
+#endif /* SD_HOST_EMULATION */
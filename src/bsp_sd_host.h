@@ -0,0 +1,122 @@
+/**
+  ******************************************************************************
+  * @file    bsp_sd_host.h
+  * @brief   This file contains the definitions and functions prototypes of
+  *          the host (PC) emulation of the bsp_sd.c driver.
+  *          It is only used when SD_HOST_EMULATION is defined and allows to
+  *          run the whole SD stack over a RAM or file backed disk image.
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BSP_SD_HOST_H
+#define __BSP_SD_HOST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <stddef.h>
+
+/* Minimal subset of the HAL definitions used by the SD stack */
+#ifndef __weak
+#define __weak                   __attribute__((weak))
+#endif
+#ifndef UNUSED
+#define UNUSED(X)                (void)X
+#endif
+#ifndef NUM_DIGITAL_PINS
+#define NUM_DIGITAL_PINS         0xFFFFFFFFU
+#endif
+
+#define CARD_SDSC                0x00000000U
+#define CARD_SDHC_SDXC           0x00000001U
+#define CARD_SECURED             0x00000003U
+#define CARD_V1_X                0x00000000U
+#define CARD_V2_X                0x00000001U
+
+typedef struct {
+  uint32_t CardType;     /*!< Specifies the card Type                         */
+  uint32_t CardVersion;  /*!< Specifies the card version                      */
+  uint32_t Class;        /*!< Specifies the class of the card class           */
+  uint32_t RelCardAdd;   /*!< Specifies the Relative Card Address             */
+  uint32_t BlockNbr;     /*!< Specifies the Card Capacity in blocks           */
+  uint32_t BlockSize;    /*!< Specifies one block size in bytes               */
+  uint32_t LogBlockNbr;  /*!< Specifies the Card logical Capacity in blocks   */
+  uint32_t LogBlockSize; /*!< Specifies logical block size in bytes           */
+} HAL_SD_CardInfoTypeDef;
+
+typedef struct __SD_HandleTypeDef SD_HandleTypeDef;
+typedef struct __GPIO_TypeDef GPIO_TypeDef;
+
+/* Host emulation definitions */
+#define SD_HOST_BLOCK_SIZE       512U
+
+/* Latency/bandwidth model of the emulated card, all values in microseconds */
+typedef struct {
+  uint32_t CmdOverheadUs; /*!< Cost of each read/write/erase command            */
+  uint32_t ReadBlockUs;   /*!< Transfer cost of each block read                 */
+  uint32_t WriteBlockUs;  /*!< Transfer cost of each block written              */
+  uint32_t WriteBusyUs;   /*!< Card busy (programming) time after a write       */
+  uint32_t EraseBlockUs;  /*!< Cost of each erased block                        */
+  uint8_t  RealTime;      /*!< 1: sleep for the modelled time, 0: only count it */
+} BSP_SD_HostTiming;
+
+/* Statistics of the emulated card traffic */
+typedef struct {
+  uint32_t ReadCmds;      /*!< Number of BSP_SD_ReadBlocks calls                */
+  uint32_t WriteCmds;     /*!< Number of BSP_SD_WriteBlocks calls               */
+  uint32_t EraseCmds;     /*!< Number of BSP_SD_Erase calls                     */
+  uint32_t BusyPolls;     /*!< Number of BSP_SD_GetCardState calls seeing busy  */
+  uint32_t PreEraseCmds;  /*!< Number of ACMD23 sent before multi-block writes  */
+  uint64_t BlocksRead;    /*!< Number of blocks read                            */
+  uint64_t BlocksWritten; /*!< Number of blocks written                         */
+  uint64_t BlocksErased;  /*!< Number of blocks erased                          */
+  uint64_t ElapsedUs;     /*!< Modelled time spent in the card                  */
+} BSP_SD_HostStats;
+
+/* Trace operations reported to the trace callback */
+#define SD_HOST_TRACE_READ       'R'
+#define SD_HOST_TRACE_WRITE      'W'
+#define SD_HOST_TRACE_ERASE      'E'
+
+uint8_t BSP_SD_HostAttachRam(uint8_t *image, uint32_t NumOfBlocks);
+uint8_t BSP_SD_HostAttachFile(const char *path, uint32_t NumOfBlocks);
+void    BSP_SD_HostDetach(void);
+void    BSP_SD_HostSetTiming(const BSP_SD_HostTiming *timing);
+void    BSP_SD_HostGetStats(BSP_SD_HostStats *stats);
+void    BSP_SD_HostResetStats(void);
+void    BSP_SD_HostSetTrace(void (*callback)(char op, uint32_t addr, uint32_t NumOfBlocks));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BSP_SD_HOST_H */
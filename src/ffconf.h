@@ -5,7 +5,9 @@
 #ifndef _ARDUINO_FFCONF_H
 #define _ARDUINO_FFCONF_H
 
+#ifndef SD_HOST_EMULATION
 #include "stm32_def.h"
+#endif
 #include "bsp_sd.h"
 
 /* FatFs specific configuration options. */
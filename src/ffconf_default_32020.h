@@ -136,7 +136,16 @@
 /  This option has no effect when _LFN_UNICODE is 0. */
 
 
+/* Could be redefined in variant.h or using build_opt.h */
+/* Relative paths are only used by the path lookup cache of the library */
+#ifndef SD_DIR_CACHE_ENTRIES
+#define SD_DIR_CACHE_ENTRIES 0
+#endif
+#if SD_DIR_CACHE_ENTRIES > 0
+#define _FS_RPATH       1
+#else
 #define _FS_RPATH       0/* 0 to 2 */
+#endif
 /* The _FS_RPATH option configures relative path feature.
 /
 /   0: Disable relative path feature and remove related functions.
@@ -206,9 +215,21 @@
 /* A header file that defines sync object types on the O/S, such as
 /  windows.h, ucos_ii.h and semphr.h, must be included prior to ff.h. */
 
-#define _FS_REENTRANT    0  /* 0:Disable or 1:Enable */
+/* Could be redefined in variant.h or using build_opt.h */
+#ifndef SD_FS_REENTRANT
+#define SD_FS_REENTRANT  0
+#endif
+#define _FS_REENTRANT    SD_FS_REENTRANT  /* 0:Disable or 1:Enable */
 #define _FS_TIMEOUT      1000 /* Timeout period in unit of time ticks */
+#if _FS_REENTRANT && defined(SD_HOST_EMULATION)
+#include <pthread.h>
+#define _SYNC_t          pthread_mutex_t *
+#elif _FS_REENTRANT
+#include "cmsis_os.h"
+#define _SYNC_t          osSemaphoreId
+#else
 #define _SYNC_t          0 /* O/S dependent type of sync object. e.g. HANDLE, OS_EVENT*, ID and etc.. */
+#endif
 
 /* The _FS_REENTRANT option switches the re-entrancy (thread safe) of the FatFs module.
 /
@@ -91,7 +91,7 @@
 /* This option switches fast seek function. (0:Disable or 1:Enable) */
 
 
-#define _USE_EXPAND   0
+#define _USE_EXPAND   1
 /* This option switches f_expand function. (0:Disable or 1:Enable) */
 
 
@@ -178,7 +178,16 @@
 /  This option has no effect when _LFN_UNICODE == 0. */
 
 
+/* Could be redefined in variant.h or using build_opt.h */
+/* Relative paths are only used by the path lookup cache of the library */
+#ifndef SD_DIR_CACHE_ENTRIES
+#define SD_DIR_CACHE_ENTRIES 0
+#endif
+#if SD_DIR_CACHE_ENTRIES > 0
+#define _FS_RPATH 1
+#else
 #define _FS_RPATH 0
+#endif
 /* This option configures support of relative path.
 /
 /   0: Disable relative path and remove related functions.
@@ -223,7 +232,7 @@
 /  disk_ioctl() function. */
 
 
-#define _USE_TRIM 0
+#define _USE_TRIM 1
 /* This option switches support of ATA-TRIM. (0:Disable or 1:Enable)
 /  To enable Trim function, also CTRL_TRIM command should be implemented to the
 /  disk_ioctl() function. */
@@ -284,13 +293,22 @@
 /      can be opened simultaneously under file lock control. Note that the file
 /      lock control is independent of re-entrancy. */
 
-#define _FS_REENTRANT 0
+/* Could be redefined in variant.h or using build_opt.h */
+#ifndef SD_FS_REENTRANT
+#define SD_FS_REENTRANT 0
+#endif
+#define _FS_REENTRANT SD_FS_REENTRANT
 
 #if _FS_REENTRANT
-#include "cmsis_os.h"
 #define _FS_TIMEOUT   1000
+#ifdef SD_HOST_EMULATION
+#include <pthread.h>
+#define _SYNC_t         pthread_mutex_t *
+#else
+#include "cmsis_os.h"
 #define _SYNC_t         osSemaphoreId
 #endif
+#endif
 /* The option _FS_REENTRANT switches the re-entrancy (thread safe) of the FatFs
 /  module itself. Note that regardless of this option, file access to different
 /  volume is always re-entrant and volume control functions, f_mount(), f_mkfs()
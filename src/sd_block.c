@@ -0,0 +1,227 @@
+/**
+******************************************************************************
+* @file    sd_block.c
+* @brief   This file includes the SD block layer: the disk I/O driver linked
+*          to FatFs in place of SD_Driver. Sector accesses go through the
+*          sector cache then the read-ahead (reads) or the write queue
+*          (writes), the card itself is accessed through SD_Driver.
+******************************************************************************
+* @attention
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*   1. Redistributions of source code must retain the above copyright notice,
+*      this list of conditions and the following disclaimer.
+*   2. Redistributions in binary form must reproduce the above copyright notice,
+*      this list of conditions and the following disclaimer in the documentation
+*      and/or other materials provided with the distribution.
+*   3. Neither the name of STMicroelectronics nor the names of its contributors
+*      may be used to endorse or promote products derived from this software
+*      without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+******************************************************************************
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "sd_block.h"
+#include "sd_cache.h"
+#include "sd_readahead.h"
+#include "sd_wqueue.h"
+#include "sd_trim.h"
+#include "sd_freemap.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static DSTATUS SD_Block_initialize(BYTE lun);
+static DSTATUS SD_Block_status(BYTE lun);
+static DRESULT SD_Block_read(BYTE lun, BYTE *buff, DWORD sector, UINT count);
+#if _USE_WRITE == 1
+static DRESULT SD_Block_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count);
+#endif /* _USE_WRITE == 1 */
+#if _USE_IOCTL == 1
+static DRESULT SD_Block_ioctl(BYTE lun, BYTE cmd, void *buff);
+#endif  /* _USE_IOCTL == 1 */
+
+/* Volume window set by the formatter */
+static DWORD block_offset = 0;
+static DWORD block_count = 0;
+static DWORD block_erase = 0;
+
+Diskio_drvTypeDef SD_BlockDriver = {
+  SD_Block_initialize,
+  SD_Block_status,
+  SD_Block_read,
+#if  _USE_WRITE == 1
+  SD_Block_write,
+#endif /* _USE_WRITE == 1 */
+#if  _USE_IOCTL == 1
+  SD_Block_ioctl,
+#endif /* _USE_IOCTL == 1 */
+};
+
+/**
+  * @brief  Reads sector(s) from the card, below the caching layers.
+  * @param  lun : not used
+  * @param  *buff: Data buffer to store read data
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to read
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_Block_DevRead(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+  DRESULT res = SD_ReadAhead_Read(lun, buff, sector, count);
+  if (res == RES_OK) {
+    SD_WQueue_Overlay(buff, sector, count);
+  }
+  return res;
+}
+
+/**
+  * @brief  Writes sector(s) to the card, below the caching layers.
+  * @param  lun : not used
+  * @param  *buff: Data to be written
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to write
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_Block_DevWrite(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+  SD_Trim_Cancel(sector, count);
+  return SD_WQueue_Write(lun, buff, sector, count);
+}
+
+/**
+  * @brief  Writes sector(s) to the card, below the write queue.
+  * @param  lun : not used
+  * @param  *buff: Data to be written
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to write
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_Block_CardWrite(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+  SD_ReadAhead_Invalidate(sector, count);
+  return SD_Driver.disk_write(lun, buff, sector, count);
+}
+
+/**
+  * @brief  Restricts the FatFs accesses to a range of sectors, FatFs sector 0
+  *         being the first sector of the range. Used to format a partition.
+  * @param  offset: first sector of the range
+  * @param  count: number of sectors of the range, 0 to remove the window
+  * @param  erase_block: erase block size reported to FatFs (sectors), 0 for the card one
+  */
+void SD_Block_SetWindow(DWORD offset, DWORD count, DWORD erase_block)
+{
+  block_offset = (count != 0) ? offset : 0;
+  block_count = count;
+  block_erase = erase_block;
+}
+
+/**
+  * @brief  Initializes a Drive
+  * @param  lun : not used
+  * @retval DSTATUS: Operation status
+  */
+static DSTATUS SD_Block_initialize(BYTE lun)
+{
+  SD_Cache_Init();
+  SD_ReadAhead_Init();
+  SD_WQueue_Init();
+  SD_Trim_Init();
+  return SD_Driver.disk_initialize(lun);
+}
+
+/**
+  * @brief  Gets Disk Status
+  * @param  lun : not used
+  * @retval DSTATUS: Operation status
+  */
+static DSTATUS SD_Block_status(BYTE lun)
+{
+  SD_ReadAhead_Sync();
+  return SD_Driver.disk_status(lun);
+}
+
+/**
+  * @brief  Reads Sector(s)
+  * @param  lun : not used
+  * @param  *buff: Data buffer to store read data
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to read (1..128)
+  * @retval DRESULT: Operation result
+  */
+static DRESULT SD_Block_read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+  DRESULT res = SD_Cache_Read(lun, buff, sector + block_offset, count);
+  if (res == RES_OK) {
+    SD_FreeMap_Read(buff, sector + block_offset, count);
+  }
+  return res;
+}
+
+#if _USE_WRITE == 1
+/**
+  * @brief  Writes Sector(s)
+  * @param  lun : not used
+  * @param  *buff: Data to be written
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to write (1..128)
+  * @retval DRESULT: Operation result
+  */
+static DRESULT SD_Block_write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+  sector += block_offset;
+  /* The sectors are in use again, possibly held by the cache for now */
+  SD_Trim_Cancel(sector, count);
+  SD_FreeMap_Write(lun, buff, sector, count);
+  return SD_Cache_Write(lun, buff, sector, count);
+}
+#endif /* _USE_WRITE == 1 */
+
+#if _USE_IOCTL == 1
+/**
+  * @brief  I/O control operation
+  * @param  lun : not used
+  * @param  cmd: Control code
+  * @param  *buff: Buffer to send/receive control data
+  * @retval DRESULT: Operation result
+  */
+static DRESULT SD_Block_ioctl(BYTE lun, BYTE cmd, void *buff)
+{
+  if (cmd == CTRL_SYNC) {
+    DRESULT res = SD_Cache_Flush(lun);
+    if (res == RES_OK) {
+      res = SD_WQueue_Flush(lun);
+    }
+    if (res != RES_OK) {
+      return res;
+    }
+  }
+#if _USE_TRIM == 1
+  if (cmd == CTRL_TRIM) {
+    return SD_Trim_Range(lun, ((DWORD *)buff)[0] + block_offset, ((DWORD *)buff)[1] + block_offset);
+  }
+#endif
+  if ((cmd == GET_SECTOR_COUNT) && (block_count != 0)) {
+    *(DWORD *)buff = block_count;
+    return RES_OK;
+  }
+  if ((cmd == GET_BLOCK_SIZE) && (block_erase != 0)) {
+    *(DWORD *)buff = block_erase;
+    return RES_OK;
+  }
+  SD_ReadAhead_Sync();
+  return SD_Driver.disk_ioctl(lun, cmd, buff);
+}
+#endif /* _USE_IOCTL == 1 */
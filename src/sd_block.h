@@ -0,0 +1,64 @@
+/**
+  ******************************************************************************
+  * @file    sd_block.h
+  * @brief   This file contains the definitions and functions prototypes of
+  *          the SD block layer, the disk I/O driver linked to FatFs which sits
+  *          between FatFs and the BSP SD driver.
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SD_BLOCK_H
+#define __SD_BLOCK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "FatFs.h"
+
+/* SD card sector size */
+#define SD_BLOCK_SIZE            512U
+
+/* Disk I/O driver to link to FatFs instead of SD_Driver */
+extern Diskio_drvTypeDef SD_BlockDriver;
+
+/* Access to the card below the caching layers */
+DRESULT SD_Block_DevRead(BYTE lun, BYTE *buff, DWORD sector, UINT count);
+DRESULT SD_Block_DevWrite(BYTE lun, const BYTE *buff, DWORD sector, UINT count);
+/* Access to the card below the write queue */
+DRESULT SD_Block_CardWrite(BYTE lun, const BYTE *buff, DWORD sector, UINT count);
+/* Volume window used by the formatter */
+void    SD_Block_SetWindow(DWORD offset, DWORD count, DWORD erase_block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SD_BLOCK_H */
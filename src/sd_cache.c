@@ -0,0 +1,486 @@
+/**
+******************************************************************************
+* @file    sd_cache.c
+* @brief   This file includes the N-way set-associative sector cache of the
+*          SD block layer. Single sector accesses (FAT, directory and partial
+*          data sectors) are cached, multi-sector transfers bypass the cache.
+*          Sectors belonging to a pinned range are evicted last.
+******************************************************************************
+* @attention
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*   1. Redistributions of source code must retain the above copyright notice,
+*      this list of conditions and the following disclaimer.
+*   2. Redistributions in binary form must reproduce the above copyright notice,
+*      this list of conditions and the following disclaimer in the documentation
+*      and/or other materials provided with the distribution.
+*   3. Neither the name of STMicroelectronics nor the names of its contributors
+*      may be used to endorse or promote products derived from this software
+*      without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+******************************************************************************
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "sd_cache.h"
+#include "sd_block.h"
+#include <string.h>
+
+#if SD_CACHE_SETS > 0
+
+#define SD_CACHE_LINES           (SD_CACHE_SETS * SD_CACHE_WAYS)
+
+typedef struct {
+  DWORD sector;     /* Cached sector number */
+  uint32_t stamp;   /* LRU: last access time */
+  uint8_t valid;
+  uint8_t dirty;
+  uint8_t pinned;
+  uint8_t ref;      /* CLOCK: referenced bit */
+} SD_CacheLine;
+
+typedef struct {
+  DWORD start;
+  DWORD count;
+} SD_CacheRange;
+
+/* Cache Private Variables */
+static SD_CacheLine cache_lines[SD_CACHE_LINES];
+/* Word aligned to allow DMA transfers from/to the cache */
+static uint32_t cache_data[SD_CACHE_LINES][SD_BLOCK_SIZE / 4];
+static SD_CacheRange cache_pins[SD_CACHE_PIN_RANGES];
+static SD_CacheStats cache_stats;
+#if SD_CACHE_POLICY == SD_CACHE_CLOCK
+static int cache_hand[SD_CACHE_SETS];
+#else
+static uint32_t cache_clock;
+#endif
+
+/**
+  * @brief  Index of the first line of the set holding a sector.
+  */
+static inline int cache_set(DWORD sector)
+{
+  return (int)(sector & (SD_CACHE_SETS - 1)) * SD_CACHE_WAYS;
+}
+
+/**
+  * @brief  Check if a sector belongs to a pinned range.
+  */
+static uint8_t cache_is_pinned(DWORD sector)
+{
+  for (int i = 0; i < SD_CACHE_PIN_RANGES; i++) {
+    if ((cache_pins[i].count != 0) && (sector >= cache_pins[i].start) &&
+        ((sector - cache_pins[i].start) < cache_pins[i].count)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  Look for a sector in the cache.
+  * @retval line index or -1 if not cached
+  */
+static int cache_lookup(DWORD sector)
+{
+  int set = cache_set(sector);
+  for (int i = set; i < (set + SD_CACHE_WAYS); i++) {
+    if (cache_lines[i].valid && (cache_lines[i].sector == sector)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+  * @brief  Mark a line as recently used.
+  */
+static inline void cache_touch(int idx)
+{
+#if SD_CACHE_POLICY == SD_CACHE_CLOCK
+  cache_lines[idx].ref = 1;
+#else
+  cache_lines[idx].stamp = ++cache_clock;
+#endif
+}
+
+/**
+  * @brief  Select the line to replace to cache a sector.
+  *         A pinned line is only replaced by a pinned sector and pinned
+  *         sectors use at most SD_CACHE_WAYS - 1 ways of a set.
+  * @retval line index or -1 if the sector should not be cached
+  */
+static int cache_victim(DWORD sector, uint8_t pinned)
+{
+  int set = cache_set(sector);
+  int victim = -1;
+  int npinned = 0;
+
+  for (int i = set; i < (set + SD_CACHE_WAYS); i++) {
+    if (!cache_lines[i].valid) {
+      return i;
+    }
+    npinned += cache_lines[i].pinned;
+  }
+  /* 0: only unpinned lines, 1: any line, 2: only pinned lines */
+  int allowed = 0;
+  if (pinned) {
+    allowed = ((SD_CACHE_WAYS > 1) && (npinned >= (SD_CACHE_WAYS - 1))) ? 2 : 1;
+  }
+#if SD_CACHE_POLICY == SD_CACHE_CLOCK
+  int *hand = &cache_hand[set / SD_CACHE_WAYS];
+  /* First round clears the referenced bits, second one finds an unreferenced line */
+  for (int n = 0; n < (2 * SD_CACHE_WAYS); n++) {
+    int i = set + *hand;
+    *hand = (*hand + 1) % SD_CACHE_WAYS;
+    if (((allowed == 0) && cache_lines[i].pinned) || ((allowed == 2) && !cache_lines[i].pinned)) {
+      continue;
+    }
+    if (cache_lines[i].ref) {
+      cache_lines[i].ref = 0;
+    } else {
+      victim = i;
+      break;
+    }
+  }
+#else
+  uint32_t oldest = 0;
+  int rank = 2;
+  for (int i = set; i < (set + SD_CACHE_WAYS); i++) {
+    if (((allowed == 0) && cache_lines[i].pinned) || ((allowed == 2) && !cache_lines[i].pinned)) {
+      continue;
+    }
+    /* Least recently used, unpinned lines first when any line is allowed */
+    int r = (allowed == 1) ? cache_lines[i].pinned : 0;
+    if ((r < rank) || ((r == rank) && ((int32_t)(cache_lines[i].stamp - oldest) < 0))) {
+      victim = i;
+      rank = r;
+      oldest = cache_lines[i].stamp;
+    }
+  }
+#endif
+  return victim;
+}
+
+/**
+  * @brief  Write a dirty line to the card.
+  */
+static DRESULT cache_writeback(BYTE lun, int idx)
+{
+  DRESULT res = RES_OK;
+  if (cache_lines[idx].valid && cache_lines[idx].dirty) {
+    res = SD_Block_DevWrite(lun, (const BYTE *)cache_data[idx], cache_lines[idx].sector, 1);
+    if (res == RES_OK) {
+      cache_lines[idx].dirty = 0;
+      cache_stats.WriteBacks++;
+    }
+  }
+  return res;
+}
+
+/**
+  * @brief  Get a free line to cache a sector, writing back the replaced one if dirty.
+  * @param  idx: line index or -1 if the sector should not be cached
+  */
+static DRESULT cache_allocate(BYTE lun, DWORD sector, int *idx)
+{
+  uint8_t pinned = cache_is_pinned(sector);
+  DRESULT res = RES_OK;
+
+  *idx = cache_victim(sector, pinned);
+  if (*idx >= 0) {
+    res = cache_writeback(lun, *idx);
+    if (res == RES_OK) {
+      if (cache_lines[*idx].valid) {
+        cache_stats.Evictions++;
+      }
+      cache_lines[*idx].valid = 0;
+      cache_lines[*idx].sector = sector;
+      cache_lines[*idx].pinned = pinned;
+    }
+  }
+  return res;
+}
+
+/**
+  * @brief  Initializes (empties) the cache. Pinned ranges are kept.
+  */
+void SD_Cache_Init(void)
+{
+  memset(cache_lines, 0, sizeof(cache_lines));
+  memset(&cache_stats, 0, sizeof(cache_stats));
+}
+
+/**
+  * @brief  Reads sector(s) through the cache.
+  * @param  lun : not used
+  * @param  *buff: Data buffer to store read data
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to read (1..128)
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_Cache_Read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+  DRESULT res;
+  int idx;
+
+  if (count == 1) {
+    idx = cache_lookup(sector);
+    if (idx >= 0) {
+      cache_stats.Hits++;
+    } else {
+      cache_stats.Misses++;
+      res = cache_allocate(lun, sector, &idx);
+      if (res != RES_OK) {
+        return res;
+      }
+      if (idx < 0) {
+        cache_stats.Bypass++;
+        return SD_Block_DevRead(lun, buff, sector, 1);
+      }
+      res = SD_Block_DevRead(lun, (BYTE *)cache_data[idx], sector, 1);
+      if (res != RES_OK) {
+        return res;
+      }
+      cache_lines[idx].valid = 1;
+      cache_lines[idx].dirty = 0;
+    }
+    cache_touch(idx);
+    memcpy(buff, cache_data[idx], SD_BLOCK_SIZE);
+    return RES_OK;
+  }
+
+  /* Bulk data transfer: do not pollute the cache */
+  cache_stats.Bypass += count;
+  res = SD_Block_DevRead(lun, buff, sector, count);
+#if SD_CACHE_WRITE_BACK
+  if (res == RES_OK) {
+    /* Dirty sectors are more recent than the card content */
+    for (idx = 0; idx < SD_CACHE_LINES; idx++) {
+      if (cache_lines[idx].valid && cache_lines[idx].dirty &&
+          (cache_lines[idx].sector >= sector) && ((cache_lines[idx].sector - sector) < count)) {
+        memcpy(&buff[(cache_lines[idx].sector - sector) * SD_BLOCK_SIZE], cache_data[idx], SD_BLOCK_SIZE);
+      }
+    }
+  }
+#endif
+  return res;
+}
+
+/**
+  * @brief  Writes sector(s) through the cache.
+  * @param  lun : not used
+  * @param  *buff: Data to be written
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to write (1..128)
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_Cache_Write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+  DRESULT res;
+  int idx;
+
+  if (count == 1) {
+    idx = cache_lookup(sector);
+#if SD_CACHE_WRITE_BACK
+    if (idx < 0) {
+      res = cache_allocate(lun, sector, &idx);
+      if (res != RES_OK) {
+        return res;
+      }
+      if (idx < 0) {
+        cache_stats.Bypass++;
+        return SD_Block_DevWrite(lun, buff, sector, 1);
+      }
+    }
+    cache_lines[idx].dirty = 1;
+#else
+    res = SD_Block_DevWrite(lun, buff, sector, 1);
+    if (res != RES_OK) {
+      if (idx >= 0) {
+        cache_lines[idx].valid = 0;
+      }
+      return res;
+    }
+    if (idx < 0) {
+      res = cache_allocate(lun, sector, &idx);
+      if ((res != RES_OK) || (idx < 0)) {
+        return RES_OK;
+      }
+    }
+    cache_lines[idx].dirty = 0;
+#endif
+    memcpy(cache_data[idx], buff, SD_BLOCK_SIZE);
+    cache_lines[idx].valid = 1;
+    cache_touch(idx);
+    return RES_OK;
+  }
+
+  /* Bulk data transfer: update the cached copies only */
+  cache_stats.Bypass += count;
+  res = SD_Block_DevWrite(lun, buff, sector, count);
+  for (idx = 0; idx < SD_CACHE_LINES; idx++) {
+    if (cache_lines[idx].valid && (cache_lines[idx].sector >= sector) &&
+        ((cache_lines[idx].sector - sector) < count)) {
+#if SD_CACHE_WRITE_BACK
+      memcpy(cache_data[idx], &buff[(cache_lines[idx].sector - sector) * SD_BLOCK_SIZE], SD_BLOCK_SIZE);
+      cache_lines[idx].dirty = (res != RES_OK);
+#else
+      if (res == RES_OK) {
+        memcpy(cache_data[idx], &buff[(cache_lines[idx].sector - sector) * SD_BLOCK_SIZE], SD_BLOCK_SIZE);
+      } else {
+        cache_lines[idx].valid = 0;
+      }
+#endif
+    }
+  }
+  return res;
+}
+
+/**
+  * @brief  Writes all dirty sectors to the card, in ascending sector order.
+  * @param  lun : not used
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_Cache_Flush(BYTE lun)
+{
+  DRESULT res = RES_OK;
+#if SD_CACHE_WRITE_BACK
+  while (res == RES_OK) {
+    int next = -1;
+    for (int idx = 0; idx < SD_CACHE_LINES; idx++) {
+      if (cache_lines[idx].valid && cache_lines[idx].dirty &&
+          ((next < 0) || (cache_lines[idx].sector < cache_lines[next].sector))) {
+        next = idx;
+      }
+    }
+    if (next < 0) {
+      break;
+    }
+    res = cache_writeback(lun, next);
+  }
+#else
+  UNUSED(lun);
+#endif
+  return res;
+}
+
+/**
+  * @brief  Drops the cached copies of sector(s), dirty or not.
+  *         To be used when the card content is changed below the cache.
+  * @param  sector: First sector
+  * @param  count: Number of sectors
+  */
+void SD_Cache_Invalidate(DWORD sector, UINT count)
+{
+  for (int idx = 0; idx < SD_CACHE_LINES; idx++) {
+    if (cache_lines[idx].valid && (cache_lines[idx].sector >= sector) &&
+        ((cache_lines[idx].sector - sector) < count)) {
+      cache_lines[idx].valid = 0;
+      cache_lines[idx].dirty = 0;
+    }
+  }
+}
+
+/**
+  * @brief  Pins a range of sectors (e.g. FAT or directory), evicted only by
+  *         other pinned sectors.
+  * @param  sector: First sector
+  * @param  count: Number of sectors
+  * @retval 1 if pinned, 0 if all ranges are used
+  */
+uint8_t SD_Cache_Pin(DWORD sector, DWORD count)
+{
+  for (int i = 0; i < SD_CACHE_PIN_RANGES; i++) {
+    if (cache_pins[i].count == 0) {
+      cache_pins[i].start = sector;
+      cache_pins[i].count = count;
+      for (int idx = 0; idx < SD_CACHE_LINES; idx++) {
+        if (cache_lines[idx].valid && cache_is_pinned(cache_lines[idx].sector)) {
+          cache_lines[idx].pinned = 1;
+        }
+      }
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  Removes all pinned ranges.
+  */
+void SD_Cache_UnpinAll(void)
+{
+  memset(cache_pins, 0, sizeof(cache_pins));
+  for (int idx = 0; idx < SD_CACHE_LINES; idx++) {
+    cache_lines[idx].pinned = 0;
+  }
+}
+
+/**
+  * @brief  Get the cache statistics.
+  * @param  stats: Pointer to the statistics structure to fill
+  */
+void SD_Cache_GetStats(SD_CacheStats *stats)
+{
+  *stats = cache_stats;
+}
+
+#else /* SD_CACHE_SETS == 0 */
+
+void SD_Cache_Init(void)
+{
+}
+
+DRESULT SD_Cache_Read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+  return SD_Block_DevRead(lun, buff, sector, count);
+}
+
+DRESULT SD_Cache_Write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+  return SD_Block_DevWrite(lun, buff, sector, count);
+}
+
+DRESULT SD_Cache_Flush(BYTE lun)
+{
+  UNUSED(lun);
+  return RES_OK;
+}
+
+void SD_Cache_Invalidate(DWORD sector, UINT count)
+{
+  UNUSED(sector);
+  UNUSED(count);
+}
+
+uint8_t SD_Cache_Pin(DWORD sector, DWORD count)
+{
+  UNUSED(sector);
+  UNUSED(count);
+  return 0;
+}
+
+void SD_Cache_UnpinAll(void)
+{
+}
+
+void SD_Cache_GetStats(SD_CacheStats *stats)
+{
+  memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* SD_CACHE_SETS > 0 */
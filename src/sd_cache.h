@@ -0,0 +1,105 @@
+/**
+  ******************************************************************************
+  * @file    sd_cache.h
+  * @brief   This file contains the definitions and functions prototypes of
+  *          the set-associative sector cache used by the SD block layer.
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SD_CACHE_H
+#define __SD_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "FatFs.h"
+
+/* Cache eviction policies */
+#define SD_CACHE_LRU             0
+#define SD_CACHE_CLOCK           1
+
+/* Could be redefined in variant.h or using build_opt.h */
+/* Number of sets, must be a power of 2. 0 disables the cache */
+#ifndef SD_CACHE_SETS
+#define SD_CACHE_SETS            0
+#endif
+
+/* Number of ways (sectors) per set */
+#ifndef SD_CACHE_WAYS
+#define SD_CACHE_WAYS            4
+#endif
+
+#ifndef SD_CACHE_POLICY
+#define SD_CACHE_POLICY          SD_CACHE_LRU
+#endif
+
+/* 0: write-through, 1: write-back (dirty sectors written on sync or eviction) */
+#ifndef SD_CACHE_WRITE_BACK
+#define SD_CACHE_WRITE_BACK      0
+#endif
+
+/* Maximum number of pinned sector ranges */
+#ifndef SD_CACHE_PIN_RANGES
+#define SD_CACHE_PIN_RANGES      4
+#endif
+
+/* Pin the FAT (and FAT12/16 root directory) at mount */
+#ifndef SD_CACHE_PIN_FAT
+#define SD_CACHE_PIN_FAT         1
+#endif
+
+#if (SD_CACHE_SETS & (SD_CACHE_SETS - 1)) != 0
+#error "SD_CACHE_SETS must be a power of 2"
+#endif
+
+/* Sector cache statistics */
+typedef struct {
+  uint32_t Hits;        /*!< Sectors served from the cache                 */
+  uint32_t Misses;      /*!< Sectors read from the card                    */
+  uint32_t Bypass;      /*!< Sectors transferred without being cached      */
+  uint32_t Evictions;   /*!< Valid sectors replaced                        */
+  uint32_t WriteBacks;  /*!< Dirty sectors written to the card             */
+} SD_CacheStats;
+
+void    SD_Cache_Init(void);
+DRESULT SD_Cache_Read(BYTE lun, BYTE *buff, DWORD sector, UINT count);
+DRESULT SD_Cache_Write(BYTE lun, const BYTE *buff, DWORD sector, UINT count);
+DRESULT SD_Cache_Flush(BYTE lun);
+void    SD_Cache_Invalidate(DWORD sector, UINT count);
+uint8_t SD_Cache_Pin(DWORD sector, DWORD count);
+void    SD_Cache_UnpinAll(void);
+void    SD_Cache_GetStats(SD_CacheStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SD_CACHE_H */
@@ -0,0 +1,297 @@
+/**
+******************************************************************************
+* @file    sd_freemap.c
+* @brief   This file includes the free cluster map of the SD block layer:
+*          the number of free clusters of each group of FAT sectors, built
+*          by reading the FAT once then kept up to date from the FAT sector
+*          writes of FatFs. It gives FatFs its free cluster count and points
+*          its allocation hint (last_clst) to a group holding free clusters.
+******************************************************************************
+* @attention
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*   1. Redistributions of source code must retain the above copyright notice,
+*      this list of conditions and the following disclaimer.
+*   2. Redistributions in binary form must reproduce the above copyright notice,
+*      this list of conditions and the following disclaimer in the documentation
+*      and/or other materials provided with the distribution.
+*   3. Neither the name of STMicroelectronics nor the names of its contributors
+*      may be used to endorse or promote products derived from this software
+*      without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+******************************************************************************
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "sd_freemap.h"
+#include "sd_block.h"
+#include "sd_cache.h"
+
+#if SD_FREEMAP_ENTRIES > 0
+
+/* Free Map Private Variables */
+static FATFS *fm_fs = NULL;
+static uint16_t fm_free[SD_FREEMAP_ENTRIES];
+static DWORD fm_sectors;    /* FAT sectors in use         */
+static DWORD fm_group;      /* FAT sectors per entry      */
+static DWORD fm_built;      /* FAT sectors already read   */
+static UINT fm_shift;       /* log2 of the FAT entry size */
+static DWORD fm_win_sector; /* FAT sector last read by FatFs, in its window */
+static UINT fm_win_free;    /* free clusters of this sector when read       */
+
+/**
+  * @brief  Count the free clusters of a FAT sector.
+  * @param  buff: sector data
+  * @param  index: sector index in the FAT
+  * @retval number of free clusters
+  */
+static UINT fm_count(const BYTE *buff, DWORD index)
+{
+  UINT entries = SD_BLOCK_SIZE >> fm_shift;
+  DWORD cluster = index * entries;
+  UINT count = 0;
+
+  for (UINT i = 0; i < entries; i++, cluster++) {
+    if ((cluster < 2) || (cluster >= fm_fs->n_fatent)) {
+      continue;
+    }
+    if (fm_shift == 2) {
+      const BYTE *p = &buff[i * 4];
+      if (((p[0] | p[1] | p[2]) == 0) && ((p[3] & 0x0F) == 0)) {
+        count++;
+      }
+    } else if ((buff[i * 2] | buff[(i * 2) + 1]) == 0) {
+      count++;
+    }
+  }
+  return count;
+}
+
+/**
+  * @brief  Give FatFs the free cluster count once the map is built.
+  */
+static void fm_publish(void)
+{
+  DWORD total = 0;
+
+  for (UINT i = 0; i <= (fm_sectors - 1) / fm_group; i++) {
+    total += fm_free[i];
+  }
+  if (fm_fs->free_clst != total) {
+    fm_fs->free_clst = total;
+    /* Update the FAT32 FSINFO sector on next sync */
+    fm_fs->fsi_flag |= 1;
+  }
+}
+
+/**
+  * @brief  Attach the map to a mounted volume, the map is empty until built.
+  *         FAT12 volumes are small enough to be scanned by FatFs.
+  * @param  fs: FatFs volume
+  */
+void SD_FreeMap_Attach(FATFS *fs)
+{
+  fm_fs = NULL;
+  if ((fs->fs_type != FS_FAT16) && (fs->fs_type != FS_FAT32)) {
+    return;
+  }
+  fm_shift = (fs->fs_type == FS_FAT32) ? 2 : 1;
+  fm_sectors = ((fs->n_fatent << fm_shift) + SD_BLOCK_SIZE - 1) / SD_BLOCK_SIZE;
+  fm_group = (fm_sectors + SD_FREEMAP_ENTRIES - 1) / SD_FREEMAP_ENTRIES;
+  if ((fm_group * (SD_BLOCK_SIZE >> fm_shift)) > 0xFFFFU) {
+    /* Too large volume for the map */
+    return;
+  }
+  fm_built = 0;
+  fm_win_sector = 0;
+  fm_fs = fs;
+}
+
+/**
+  * @brief  Detach the map from the volume (unmount, format).
+  */
+void SD_FreeMap_Detach(void)
+{
+  fm_fs = NULL;
+}
+
+/**
+  * @brief  Read the FAT to build the map.
+  * @param  sectors: maximum number of FAT sectors to read, 0 to complete the map
+  * @retval 1 when the map is built
+  */
+uint8_t SD_FreeMap_Build(UINT sectors)
+{
+  uint32_t buff[SD_BLOCK_SIZE / 4];
+  uint8_t all = (sectors == 0);
+
+  if (fm_fs == NULL) {
+    return 0;
+  }
+  while ((fm_built < fm_sectors) && (all || (sectors-- != 0))) {
+    /* Through the cache to get the last written FAT sectors */
+    if (SD_Cache_Read(fm_fs->drv, (BYTE *)buff, fm_fs->fatbase + fm_built, 1) != RES_OK) {
+      return 0;
+    }
+    if ((fm_built % fm_group) == 0) {
+      fm_free[fm_built / fm_group] = 0;
+    }
+    fm_free[fm_built / fm_group] += fm_count((const BYTE *)buff, fm_built);
+    if (++fm_built == fm_sectors) {
+      fm_publish();
+      SD_FreeMap_Hint();
+    }
+  }
+  return (fm_built == fm_sectors);
+}
+
+/**
+  * @brief  Check if the map is built
+  * @retval 1 if built
+  */
+uint8_t SD_FreeMap_Ready(void)
+{
+  return (fm_fs != NULL) && (fm_built == fm_sectors);
+}
+
+/**
+  * @brief  Note the free clusters of the FAT sector read by FatFs into its
+  *         window, to account for its changes when FatFs writes it back.
+  * @param  *buff: Data read
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors read
+  */
+void SD_FreeMap_Read(const BYTE *buff, DWORD sector, UINT count)
+{
+  /* FatFs reads the FAT one sector at a time, into its window */
+  if ((fm_fs == NULL) || (count != 1) || (sector < fm_fs->fatbase) ||
+      (sector >= fm_fs->fatbase + fm_sectors)) {
+    return;
+  }
+  fm_win_sector = sector;
+  fm_win_free = fm_count(buff, sector - fm_fs->fatbase);
+}
+
+/**
+  * @brief  Update the map from FAT sectors about to be written by FatFs.
+  *         FatFs writes back the FAT sector of its window: the old count
+  *         is the one noted by SD_FreeMap_Read(), without reading it again.
+  * @param  lun : not used
+  * @param  *buff: Data to be written
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to write
+  */
+void SD_FreeMap_Write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+  UNUSED(lun);
+  if ((fm_fs == NULL) || (sector + count <= fm_fs->fatbase) ||
+      (sector >= fm_fs->fatbase + fm_sectors)) {
+    return;
+  }
+  for (UINT i = 0; i < count; i++, sector++, buff += SD_BLOCK_SIZE) {
+    DWORD index = sector - fm_fs->fatbase;
+    UINT nfree;
+    /* Groups not built yet will read the new data */
+    if ((sector < fm_fs->fatbase) || (index >= fm_built)) {
+      continue;
+    }
+    nfree = fm_count(buff, index);
+    if (sector != fm_win_sector) {
+      /* Not read by FatFs first: rebuild the map from this group */
+      fm_built = index - (index % fm_group);
+      fm_win_sector = 0;
+      return;
+    }
+    fm_free[index / fm_group] -= fm_win_free;
+    fm_free[index / fm_group] += nfree;
+    /* The window may be changed and written again */
+    fm_win_free = nfree;
+  }
+}
+
+/**
+  * @brief  Point the FatFs allocation hint to a group holding free clusters
+  *         when the group following it has none. To call before writes.
+  */
+void SD_FreeMap_Hint(void)
+{
+  UINT groups;
+  UINT first;
+  DWORD cluster;
+
+  if (!SD_FreeMap_Ready()) {
+    return;
+  }
+  groups = ((fm_sectors - 1) / fm_group) + 1;
+  cluster = fm_fs->last_clst + 1;
+  if ((cluster < 2) || (cluster >= fm_fs->n_fatent)) {
+    cluster = 2;
+  }
+  first = ((cluster << fm_shift) / SD_BLOCK_SIZE) / fm_group;
+  for (UINT n = 0; n < groups; n++) {
+    UINT g = (first + n) % groups;
+    if (fm_free[g] != 0) {
+      if (n != 0) {
+        /* FatFs searches from the cluster following last_clst */
+        cluster = (g * fm_group * (SD_BLOCK_SIZE >> fm_shift));
+        fm_fs->last_clst = (cluster < 2) ? 1 : cluster - 1;
+      }
+      return;
+    }
+  }
+}
+
+#else /* SD_FREEMAP_ENTRIES == 0 */
+
+void SD_FreeMap_Attach(FATFS *fs)
+{
+  UNUSED(fs);
+}
+
+void SD_FreeMap_Detach(void)
+{
+}
+
+uint8_t SD_FreeMap_Build(UINT sectors)
+{
+  UNUSED(sectors);
+  return 0;
+}
+
+uint8_t SD_FreeMap_Ready(void)
+{
+  return 0;
+}
+
+void SD_FreeMap_Read(const BYTE *buff, DWORD sector, UINT count)
+{
+  UNUSED(buff);
+  UNUSED(sector);
+  UNUSED(count);
+}
+
+void SD_FreeMap_Write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+  UNUSED(lun);
+  UNUSED(buff);
+  UNUSED(sector);
+  UNUSED(count);
+}
+
+void SD_FreeMap_Hint(void)
+{
+}
+
+#endif /* SD_FREEMAP_ENTRIES > 0 */
@@ -0,0 +1,69 @@
+/**
+  ******************************************************************************
+  * @file    sd_freemap.h
+  * @brief   This file contains the definitions and functions prototypes of
+  *          the free cluster map of the SD block layer.
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SD_FREEMAP_H
+#define __SD_FREEMAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "FatFs.h"
+
+/* Could be redefined in variant.h or using build_opt.h */
+/* Number of FAT sector groups, each one holding its number of free clusters
+   (2 bytes of RAM each). 0 disables the free cluster map */
+#ifndef SD_FREEMAP_ENTRIES
+#define SD_FREEMAP_ENTRIES       0
+#endif
+
+/* Number of FAT sectors scanned by each SD_FreeMap_Build() call from SD.idle() */
+#ifndef SD_FREEMAP_IDLE_SECTORS
+#define SD_FREEMAP_IDLE_SECTORS  16
+#endif
+
+void    SD_FreeMap_Attach(FATFS *fs);
+void    SD_FreeMap_Detach(void);
+uint8_t SD_FreeMap_Build(UINT sectors);
+uint8_t SD_FreeMap_Ready(void);
+void    SD_FreeMap_Read(const BYTE *buff, DWORD sector, UINT count);
+void    SD_FreeMap_Write(BYTE lun, const BYTE *buff, DWORD sector, UINT count);
+void    SD_FreeMap_Hint(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SD_FREEMAP_H */
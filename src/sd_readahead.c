@@ -0,0 +1,282 @@
+/**
+******************************************************************************
+* @file    sd_readahead.c
+* @brief   This file includes the sequential read-ahead of the SD block
+*          layer. Reads continuing the previous one are detected from their
+*          sector addresses and the next sectors are prefetched into a ring
+*          buffer, in background when non-blocking transfers are available.
+*          The prefetch window grows while reads are not fully served from
+*          it and is dropped on a random access.
+******************************************************************************
+* @attention
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*   1. Redistributions of source code must retain the above copyright notice,
+*      this list of conditions and the following disclaimer.
+*   2. Redistributions in binary form must reproduce the above copyright notice,
+*      this list of conditions and the following disclaimer in the documentation
+*      and/or other materials provided with the distribution.
+*   3. Neither the name of STMicroelectronics nor the names of its contributors
+*      may be used to endorse or promote products derived from this software
+*      without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+******************************************************************************
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "sd_readahead.h"
+#include "sd_block.h"
+#include "bsp_sd.h"
+#include <string.h>
+
+#if SD_READAHEAD_SECTORS > 0
+
+/* Read-ahead Private Variables */
+/* Aligned for DMA transfers with data cache maintenance */
+static uint32_t ra_data[SD_READAHEAD_SECTORS][SD_BLOCK_SIZE / 4] __attribute__((aligned(32)));
+static DWORD ra_start;     /* Sector of the first buffered sector        */
+static UINT ra_head;       /* Ring index of the first buffered sector    */
+static UINT ra_count;      /* Buffered sectors, pending ones included    */
+static UINT ra_pending;    /* Last buffered sectors being transferred    */
+static DWORD ra_next;      /* Sector following the last read             */
+static DWORD ra_last;      /* Number of sectors of the card              */
+static UINT ra_seq;        /* Consecutive sequential reads               */
+static SD_ReadAheadStats ra_stats;
+
+/**
+  * @brief  Remove sectors from the front of the ring buffer.
+  * @param  n: number of sectors
+  */
+static void ra_consume(UINT n)
+{
+  ra_start += n;
+  ra_head = (ra_head + n) % SD_READAHEAD_SECTORS;
+  ra_count -= n;
+}
+
+/**
+  * @brief  Drop all buffered sectors.
+  */
+static void ra_drop(void)
+{
+  ra_stats.Wasted += ra_count;
+  ra_count = 0;
+  ra_head = 0;
+}
+
+/**
+  * @brief  Prefetch the sectors following the buffered ones, up to the
+  *         window size, in one transfer.
+  * @param  lun : not used
+  */
+static void ra_prefetch(BYTE lun)
+{
+  UINT tail;
+  UINT n;
+
+  if (ra_count == 0) {
+    ra_start = ra_next;
+    ra_head = 0;
+  }
+  if ((ra_last == 0) &&
+      (SD_Driver.disk_ioctl(lun, GET_SECTOR_COUNT, &ra_last) != RES_OK)) {
+    return;
+  }
+  /* Refill when half of the window is consumed, to keep transfers large */
+  if ((ra_count > ra_stats.Window / 2) || (ra_start + ra_count >= ra_last)) {
+    return;
+  }
+  n = ra_stats.Window - ra_count;
+  if (n > ra_last - (ra_start + ra_count)) {
+    n = ra_last - (ra_start + ra_count);
+  }
+  /* Contiguous free space of the ring */
+  tail = (ra_head + ra_count) % SD_READAHEAD_SECTORS;
+  if (n > SD_READAHEAD_SECTORS - tail) {
+    n = SD_READAHEAD_SECTORS - tail;
+  }
+#if BSP_SD_ASYNC
+  if (BSP_SD_StartReadBlocks(ra_data[tail], ra_start + ra_count, n) == MSD_OK) {
+    ra_pending = n;
+#else
+  if (SD_Driver.disk_read(lun, (BYTE *)ra_data[tail], ra_start + ra_count, n) == RES_OK) {
+#endif
+    ra_count += n;
+    ra_stats.Prefetched += n;
+  }
+}
+
+/**
+  * @brief  Initializes the read-ahead
+  */
+void SD_ReadAhead_Init(void)
+{
+  SD_ReadAhead_Sync();
+  ra_count = 0;
+  ra_head = 0;
+  ra_next = 0;
+  ra_last = 0;
+  ra_seq = 0;
+  memset(&ra_stats, 0, sizeof(ra_stats));
+  ra_stats.Window = SD_READAHEAD_MIN;
+}
+
+/**
+  * @brief  Wait for the end of the background prefetch, if any. Required
+  *         before any other access to the card.
+  */
+void SD_ReadAhead_Sync(void)
+{
+#if BSP_SD_ASYNC
+  if (ra_pending != 0) {
+    if (BSP_SD_WaitTransfer(SD_DATATIMEOUT) != MSD_OK) {
+      ra_count -= ra_pending;
+    }
+    ra_pending = 0;
+  }
+#endif
+}
+
+/**
+  * @brief  Check, without waiting, whether the background prefetch is still
+  *         in progress. The prefetch is completed when it is over.
+  * @retval 1 while the card is busy with the prefetch, 0 otherwise
+  */
+uint8_t SD_ReadAhead_Busy(void)
+{
+#if BSP_SD_ASYNC
+  uint8_t state;
+
+  if (ra_pending != 0) {
+    state = BSP_SD_PollTransfer();
+    if (state == MSD_BUSY) {
+      return 1;
+    }
+    if (state != MSD_OK) {
+      ra_count -= ra_pending;
+    }
+    ra_pending = 0;
+  }
+#endif
+  return 0;
+}
+
+/**
+  * @brief  Reads Sector(s), from the prefetched data when available
+  * @param  lun : not used
+  * @param  *buff: Data buffer to store read data
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to read
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_ReadAhead_Read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+  UINT served = 0;
+  DRESULT res = RES_OK;
+
+  SD_ReadAhead_Sync();
+  if (sector == ra_next) {
+    ra_seq++;
+  } else {
+    ra_seq = 0;
+    ra_stats.Window = SD_READAHEAD_MIN;
+  }
+  ra_next = sector + count;
+
+  if ((ra_count != 0) && (sector >= ra_start) && (sector < ra_start + ra_count)) {
+    /* Skipped sectors are lost */
+    ra_stats.Wasted += sector - ra_start;
+    ra_consume(sector - ra_start);
+    while ((served < count) && (ra_count != 0)) {
+      memcpy(&buff[served * SD_BLOCK_SIZE], ra_data[ra_head], SD_BLOCK_SIZE);
+      ra_consume(1);
+      served++;
+    }
+    ra_stats.Hits += served;
+  } else if (ra_count != 0) {
+    ra_drop();
+  }
+
+  if (served < count) {
+    res = SD_Driver.disk_read(lun, &buff[served * SD_BLOCK_SIZE], sector + served, count - served);
+    ra_stats.Misses += count - served;
+    if ((ra_seq > SD_READAHEAD_TRIGGER) && (ra_stats.Window < SD_READAHEAD_SECTORS)) {
+      /* Prefetch was too short */
+      ra_stats.Window *= 2;
+      if (ra_stats.Window > SD_READAHEAD_SECTORS) {
+        ra_stats.Window = SD_READAHEAD_SECTORS;
+      }
+    }
+  }
+  if ((res == RES_OK) && (ra_seq >= SD_READAHEAD_TRIGGER)) {
+    ra_prefetch(lun);
+  }
+  return res;
+}
+
+/**
+  * @brief  Drop the prefetched data if it overlaps written or erased sectors
+  * @param  sector: first sector
+  * @param  count: number of sectors
+  */
+void SD_ReadAhead_Invalidate(DWORD sector, UINT count)
+{
+  SD_ReadAhead_Sync();
+  if ((ra_count != 0) && (sector < ra_start + ra_count) && (sector + count > ra_start)) {
+    ra_drop();
+  }
+}
+
+/**
+  * @brief  Get the read-ahead statistics
+  * @param  stats: statistics
+  */
+void SD_ReadAhead_GetStats(SD_ReadAheadStats *stats)
+{
+  *stats = ra_stats;
+}
+
+#else /* SD_READAHEAD_SECTORS == 0 */
+
+void SD_ReadAhead_Init(void)
+{
+}
+
+DRESULT SD_ReadAhead_Read(BYTE lun, BYTE *buff, DWORD sector, UINT count)
+{
+  return SD_Driver.disk_read(lun, buff, sector, count);
+}
+
+void SD_ReadAhead_Invalidate(DWORD sector, UINT count)
+{
+  UNUSED(sector);
+  UNUSED(count);
+}
+
+void SD_ReadAhead_Sync(void)
+{
+}
+
+uint8_t SD_ReadAhead_Busy(void)
+{
+  return 0;
+}
+
+void SD_ReadAhead_GetStats(SD_ReadAheadStats *stats)
+{
+  memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* SD_READAHEAD_SECTORS > 0 */
@@ -0,0 +1,82 @@
+/**
+  ******************************************************************************
+  * @file    sd_readahead.h
+  * @brief   This file contains the definitions and functions prototypes of
+  *          the sequential read-ahead of the SD block layer.
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SD_READAHEAD_H
+#define __SD_READAHEAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "FatFs.h"
+
+/* Could be redefined in variant.h or using build_opt.h */
+/* Size in sectors of the read-ahead ring buffer. 0 disables the read-ahead */
+#ifndef SD_READAHEAD_SECTORS
+#define SD_READAHEAD_SECTORS     0
+#endif
+
+/* Number of consecutive sequential reads before prefetching */
+#ifndef SD_READAHEAD_TRIGGER
+#define SD_READAHEAD_TRIGGER     2
+#endif
+
+/* Initial prefetch window in sectors, doubled up to SD_READAHEAD_SECTORS
+   each time a sequential read is not fully served by the prefetched data */
+#ifndef SD_READAHEAD_MIN
+#define SD_READAHEAD_MIN         2
+#endif
+
+/* Read-ahead statistics */
+typedef struct {
+  uint32_t Hits;        /*!< Sectors served from the prefetched data        */
+  uint32_t Misses;      /*!< Sectors read on demand                         */
+  uint32_t Prefetched;  /*!< Sectors prefetched                             */
+  uint32_t Wasted;      /*!< Prefetched sectors dropped without being read  */
+  uint32_t Window;      /*!< Current prefetch window in sectors             */
+} SD_ReadAheadStats;
+
+void    SD_ReadAhead_Init(void);
+DRESULT SD_ReadAhead_Read(BYTE lun, BYTE *buff, DWORD sector, UINT count);
+void    SD_ReadAhead_Invalidate(DWORD sector, UINT count);
+void    SD_ReadAhead_Sync(void);
+uint8_t SD_ReadAhead_Busy(void);
+void    SD_ReadAhead_GetStats(SD_ReadAheadStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SD_READAHEAD_H */
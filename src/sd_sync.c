@@ -0,0 +1,259 @@
+/**
+******************************************************************************
+* @file    sd_sync.c
+* @brief   This file includes the locks of the SD stack. The FatFs volume
+*          lock (_FS_REENTRANT) also protects the block layer and the FATFS
+*          fields updated outside FatFs. Files are protected by a small set
+*          of recursive locks selected by the address of their FIL object.
+******************************************************************************
+* @attention
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*   1. Redistributions of source code must retain the above copyright notice,
+*      this list of conditions and the following disclaimer.
+*   2. Redistributions in binary form must reproduce the above copyright notice,
+*      this list of conditions and the following disclaimer in the documentation
+*      and/or other materials provided with the distribution.
+*   3. Neither the name of STMicroelectronics nor the names of its contributors
+*      may be used to endorse or promote products derived from this software
+*      without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+******************************************************************************
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "sd_sync.h"
+
+#if SD_SYNC == SD_SYNC_PTHREAD
+#include <pthread.h>
+#include <time.h>
+#include <stdlib.h>
+#elif SD_SYNC == SD_SYNC_CMSIS_OS
+#include "cmsis_os.h"
+#endif
+
+/* Sync Private Variables */
+static FATFS *sync_fs = NULL;
+
+#if SD_SYNC == SD_SYNC_PTHREAD
+static pthread_mutex_t sync_file_locks[SD_SYNC_FILE_LOCKS];
+static pthread_mutex_t sync_path_lock;
+#elif SD_SYNC == SD_SYNC_CMSIS_OS
+osMutexDef(sd_file_lock);
+osMutexDef(sd_path_lock);
+static osMutexId sync_file_locks[SD_SYNC_FILE_LOCKS];
+static osMutexId sync_path_lock;
+#endif
+static uint8_t sync_ready = 0;
+
+/**
+  * @brief  Get the File lock of an object
+  * @param  obj: FIL object of the File
+  * @retval lock index
+  */
+static inline UINT SD_Sync_FileLock(const void *obj)
+{
+  return (UINT)(((uintptr_t)obj / sizeof(FIL)) % SD_SYNC_FILE_LOCKS);
+}
+
+/**
+  * @brief  Create the File locks. To call before the tasks use the SD.
+  */
+void SD_Sync_Init(void)
+{
+  if (sync_ready) {
+    return;
+  }
+#if SD_SYNC == SD_SYNC_PTHREAD
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  for (UINT i = 0; i < SD_SYNC_FILE_LOCKS; i++) {
+    pthread_mutex_init(&sync_file_locks[i], &attr);
+  }
+  pthread_mutex_init(&sync_path_lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+#elif SD_SYNC == SD_SYNC_CMSIS_OS
+  for (UINT i = 0; i < SD_SYNC_FILE_LOCKS; i++) {
+    sync_file_locks[i] = osRecursiveMutexCreate(osMutex(sd_file_lock));
+  }
+  sync_path_lock = osRecursiveMutexCreate(osMutex(sd_path_lock));
+#endif
+  sync_ready = 1;
+}
+
+/**
+  * @brief  Set the volume whose FatFs lock protects the block layer
+  * @param  fs: mounted FatFs volume
+  */
+void SD_Sync_Attach(FATFS *fs)
+{
+  sync_fs = fs;
+}
+
+/**
+  * @brief  Take the FatFs volume lock, to access the block layer or the
+  *         FATFS fields outside FatFs. Never call FatFs with the lock held.
+  * @retval 1 if locked, 0 on timeout (_FS_TIMEOUT)
+  */
+uint8_t SD_Sync_LockVolume(void)
+{
+#if _FS_REENTRANT
+  if ((sync_fs == NULL) || (sync_fs->fs_type == 0)) {
+    return 1;
+  }
+  return (ff_req_grant(sync_fs->sobj) != 0);
+#else
+  return 1;
+#endif
+}
+
+/**
+  * @brief  Release the FatFs volume lock
+  */
+void SD_Sync_UnlockVolume(void)
+{
+#if _FS_REENTRANT
+  if ((sync_fs != NULL) && (sync_fs->fs_type != 0)) {
+    ff_rel_grant(sync_fs->sobj);
+  }
+#endif
+}
+
+/**
+  * @brief  Take the lock of a File (recursive), before its volume lock
+  * @param  obj: FIL object of the File
+  */
+void SD_Sync_LockFile(const void *obj)
+{
+  if (!sync_ready) {
+    return;
+  }
+#if SD_SYNC == SD_SYNC_PTHREAD
+  pthread_mutex_lock(&sync_file_locks[SD_Sync_FileLock(obj)]);
+#elif SD_SYNC == SD_SYNC_CMSIS_OS
+  osRecursiveMutexWait(sync_file_locks[SD_Sync_FileLock(obj)], osWaitForever);
+#else
+  (void)obj;
+#endif
+}
+
+/**
+  * @brief  Release the lock of a File
+  * @param  obj: FIL object of the File
+  */
+void SD_Sync_UnlockFile(const void *obj)
+{
+  if (!sync_ready) {
+    return;
+  }
+#if SD_SYNC == SD_SYNC_PTHREAD
+  pthread_mutex_unlock(&sync_file_locks[SD_Sync_FileLock(obj)]);
+#elif SD_SYNC == SD_SYNC_CMSIS_OS
+  osRecursiveMutexRelease(sync_file_locks[SD_Sync_FileLock(obj)]);
+#else
+  (void)obj;
+#endif
+}
+
+/**
+  * @brief  Take the path lock (recursive), after the File locks and before
+  *         the volume lock. It serializes the FatFs calls taking a path, as
+  *         they depend on the FatFs current directory set by the path lookup
+  *         cache, and the cache itself.
+  */
+void SD_Sync_LockPath(void)
+{
+  if (!sync_ready) {
+    return;
+  }
+#if SD_SYNC == SD_SYNC_PTHREAD
+  pthread_mutex_lock(&sync_path_lock);
+#elif SD_SYNC == SD_SYNC_CMSIS_OS
+  osRecursiveMutexWait(sync_path_lock, osWaitForever);
+#endif
+}
+
+/**
+  * @brief  Release the path lock
+  */
+void SD_Sync_UnlockPath(void)
+{
+  if (!sync_ready) {
+    return;
+  }
+#if SD_SYNC == SD_SYNC_PTHREAD
+  pthread_mutex_unlock(&sync_path_lock);
+#elif SD_SYNC == SD_SYNC_CMSIS_OS
+  osRecursiveMutexRelease(sync_path_lock);
+#endif
+}
+
+#if (SD_SYNC == SD_SYNC_PTHREAD) && _FS_REENTRANT
+/* FatFs sync object handlers of the host emulation (on target they are
+   provided by the FatFs CMSIS-RTOS option, syncobj.c) */
+
+/**
+  * @brief  Create the sync object of a volume
+  * @param  vol: volume number
+  * @param  sobj: sync object created
+  * @retval 1 if created else 0
+  */
+int ff_cre_syncobj(BYTE vol, _SYNC_t *sobj)
+{
+  (void)vol;
+  *sobj = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t));
+  return (*sobj != NULL) && (pthread_mutex_init(*sobj, NULL) == 0);
+}
+
+/**
+  * @brief  Lock a volume
+  * @param  sobj: sync object of the volume
+  * @retval 1 if locked, 0 on timeout (_FS_TIMEOUT ms)
+  */
+int ff_req_grant(_SYNC_t sobj)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += _FS_TIMEOUT / 1000;
+  ts.tv_nsec += (_FS_TIMEOUT % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  return pthread_mutex_timedlock(sobj, &ts) == 0;
+}
+
+/**
+  * @brief  Unlock a volume
+  * @param  sobj: sync object of the volume
+  */
+void ff_rel_grant(_SYNC_t sobj)
+{
+  pthread_mutex_unlock(sobj);
+}
+
+/**
+  * @brief  Delete the sync object of a volume
+  * @param  sobj: sync object
+  * @retval 1
+  */
+int ff_del_syncobj(_SYNC_t sobj)
+{
+  pthread_mutex_destroy(sobj);
+  free(sobj);
+  return 1;
+}
+#endif
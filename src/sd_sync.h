@@ -0,0 +1,87 @@
+/**
+  ******************************************************************************
+  * @file    sd_sync.h
+  * @brief   This file contains the definitions and functions prototypes of
+  *          the locks making the SD stack usable from several RTOS tasks.
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SD_SYNC_H
+#define __SD_SYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "FatFs.h"
+
+/* Lock implementations */
+#define SD_SYNC_NONE             0  /* Single task, no lock                     */
+#define SD_SYNC_CMSIS_OS         1  /* CMSIS-RTOS recursive mutexes (FreeRTOS)  */
+#define SD_SYNC_PTHREAD          2  /* POSIX recursive mutexes (host emulation) */
+
+/* Could be redefined in variant.h or using build_opt.h */
+/* Selected from the FatFs re-entrancy (SD_FS_REENTRANT) by default */
+#ifndef SD_SYNC
+#if !_FS_REENTRANT
+#define SD_SYNC                  SD_SYNC_NONE
+#elif defined(SD_HOST_EMULATION)
+#define SD_SYNC                  SD_SYNC_PTHREAD
+#else
+#define SD_SYNC                  SD_SYNC_CMSIS_OS
+#endif
+#endif
+
+/* Number of File locks, a File uses the lock selected by the address of its
+   FIL object */
+#ifndef SD_SYNC_FILE_LOCKS
+#define SD_SYNC_FILE_LOCKS       4
+#endif
+
+#if (SD_SYNC != SD_SYNC_NONE) && !_FS_REENTRANT
+#error "SD_SYNC requires SD_FS_REENTRANT (FatFs _FS_REENTRANT) set to 1"
+#endif
+
+void    SD_Sync_Init(void);
+void    SD_Sync_Attach(FATFS *fs);
+uint8_t SD_Sync_LockVolume(void);
+void    SD_Sync_UnlockVolume(void);
+void    SD_Sync_LockFile(const void *obj);
+void    SD_Sync_UnlockFile(const void *obj);
+void    SD_Sync_LockPath(void);
+void    SD_Sync_UnlockPath(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SD_SYNC_H */
@@ -0,0 +1,269 @@
+/**
+******************************************************************************
+* @file    sd_trim.c
+* @brief   This file includes the TRIM support of the SD block layer: the
+*          sector ranges freed by FatFs (CTRL_TRIM) are erased on the card,
+*          at once or later from SD_Trim_Flush() (e.g. when idle). A
+*          deferred range written again before being erased is cancelled.
+******************************************************************************
+* @attention
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*   1. Redistributions of source code must retain the above copyright notice,
+*      this list of conditions and the following disclaimer.
+*   2. Redistributions in binary form must reproduce the above copyright notice,
+*      this list of conditions and the following disclaimer in the documentation
+*      and/or other materials provided with the distribution.
+*   3. Neither the name of STMicroelectronics nor the names of its contributors
+*      may be used to endorse or promote products derived from this software
+*      without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+******************************************************************************
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "sd_trim.h"
+#include "sd_block.h"
+#include "sd_cache.h"
+#include "sd_readahead.h"
+#include "bsp_sd.h"
+#include <string.h>
+
+typedef struct {
+  DWORD start;
+  DWORD end;      /* Included */
+} SD_TrimRange;
+
+/* Trim Private Variables */
+static uint8_t trim_policy = SD_TRIM_POLICY;
+static SD_TrimRange trim_ranges[SD_TRIM_RANGES];
+static UINT trim_count;
+static SD_TrimStats trim_stats;
+
+/**
+  * @brief  Erase a range of sectors and drop their copies in the block layer.
+  * @param  lun : not used
+  * @param  start: first sector
+  * @param  end: last sector (included)
+  * @retval DRESULT: Operation result
+  */
+static DRESULT trim_erase(BYTE lun, DWORD start, DWORD end)
+{
+  UNUSED(lun);
+  SD_ReadAhead_Sync();
+  SD_Cache_Invalidate(start, end - start + 1);
+  SD_ReadAhead_Invalidate(start, end - start + 1);
+  trim_stats.Commands++;
+#ifdef STM32L1xx
+  /* Legacy HAL: byte addresses */
+  if (BSP_SD_Erase((uint64_t)start * SD_BLOCK_SIZE, (uint64_t)end * SD_BLOCK_SIZE) != MSD_OK) {
+#else
+  if (BSP_SD_Erase(start, end) != MSD_OK) {
+#endif
+    trim_stats.Errors++;
+    return RES_ERROR;
+  }
+#ifndef STM32L1xx
+  if (BSP_SD_WaitCardReady(SD_TRIM_ERASE_TIMEOUT) != MSD_OK) {
+    trim_stats.Errors++;
+    return RES_ERROR;
+  }
+#endif
+  trim_stats.Trimmed += end - start + 1;
+  return RES_OK;
+}
+
+/**
+  * @brief  Remove a deferred range.
+  * @param  idx: range index
+  */
+static void trim_remove(UINT idx)
+{
+  trim_ranges[idx] = trim_ranges[--trim_count];
+}
+
+/**
+  * @brief  Initializes the TRIM support, deferred ranges are lost
+  */
+void SD_Trim_Init(void)
+{
+  trim_count = 0;
+  memset(&trim_stats, 0, sizeof(trim_stats));
+}
+
+/**
+  * @brief  Set the TRIM policy
+  * @param  policy: SD_TRIM_DISABLED, SD_TRIM_IMMEDIATE or SD_TRIM_DEFERRED
+  */
+void SD_Trim_SetPolicy(uint8_t policy)
+{
+  if (policy != SD_TRIM_DEFERRED) {
+    trim_count = 0;
+  }
+  trim_policy = policy;
+}
+
+/**
+  * @brief  Get the TRIM policy
+  * @retval SD_TRIM_DISABLED, SD_TRIM_IMMEDIATE or SD_TRIM_DEFERRED
+  */
+uint8_t SD_Trim_GetPolicy(void)
+{
+  return trim_policy;
+}
+
+/**
+  * @brief  Handle a range of sectors freed by FatFs
+  * @param  lun : not used
+  * @param  start: first sector
+  * @param  end: last sector (included)
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_Trim_Range(BYTE lun, DWORD start, DWORD end)
+{
+  UINT i;
+
+  if (end < start) {
+    return RES_PARERR;
+  }
+  trim_stats.Requests++;
+  if (trim_policy == SD_TRIM_IMMEDIATE) {
+    return trim_erase(lun, start, end);
+  }
+  if (trim_policy != SD_TRIM_DEFERRED) {
+    return RES_OK;
+  }
+  /* Merge with the adjacent or overlapping ranges */
+  i = 0;
+  while (i < trim_count) {
+    if ((start <= trim_ranges[i].end + 1) && (trim_ranges[i].start <= end + 1)) {
+      if (trim_ranges[i].start < start) {
+        start = trim_ranges[i].start;
+      }
+      if (trim_ranges[i].end > end) {
+        end = trim_ranges[i].end;
+      }
+      trim_remove(i);
+    } else {
+      i++;
+    }
+  }
+  if (trim_count == SD_TRIM_RANGES) {
+    /* Drop the smallest range */
+    UINT smallest = SD_TRIM_RANGES;
+    DWORD size = end - start;
+    for (i = 0; i < trim_count; i++) {
+      if (trim_ranges[i].end - trim_ranges[i].start < size) {
+        size = trim_ranges[i].end - trim_ranges[i].start;
+        smallest = i;
+      }
+    }
+    trim_stats.Dropped += size + 1;
+    if (smallest == SD_TRIM_RANGES) {
+      return RES_OK;
+    }
+    trim_remove(smallest);
+  }
+  trim_ranges[trim_count].start = start;
+  trim_ranges[trim_count].end = end;
+  trim_count++;
+  return RES_OK;
+}
+
+/**
+  * @brief  Cancel the written sectors in the deferred ranges, the sectors
+  *         around them stay deferred
+  * @param  sector: first sector written
+  * @param  count: number of sectors
+  */
+void SD_Trim_Cancel(DWORD sector, UINT count)
+{
+  DWORD last = sector + count - 1;
+  UINT i = 0;
+
+  if (count == 0) {
+    return;
+  }
+  while (i < trim_count) {
+    SD_TrimRange range = trim_ranges[i];
+    if ((sector > range.end) || (range.start > last)) {
+      i++;
+      continue;
+    }
+    trim_stats.Cancelled += ((range.end < last) ? range.end : last) -
+                            ((range.start > sector) ? range.start : sector) + 1;
+    if (range.start < sector) {
+      /* Keep the sectors before the written ones */
+      trim_ranges[i].end = sector - 1;
+      i++;
+      if (range.end > last) {
+        /* and after them, in a new range if there is room */
+        if (trim_count < SD_TRIM_RANGES) {
+          trim_ranges[trim_count].start = last + 1;
+          trim_ranges[trim_count].end = range.end;
+          trim_count++;
+        } else {
+          trim_stats.Dropped += range.end - last;
+        }
+      }
+    } else if (range.end > last) {
+      /* Keep the sectors after the written ones */
+      trim_ranges[i].start = last + 1;
+      i++;
+    } else {
+      trim_remove(i);
+    }
+  }
+}
+
+/**
+  * @brief  Erase the deferred ranges
+  * @param  lun : not used
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_Trim_Flush(BYTE lun)
+{
+  DRESULT res = RES_OK;
+
+  while (trim_count != 0) {
+    SD_TrimRange range = trim_ranges[--trim_count];
+    if (trim_erase(lun, range.start, range.end) != RES_OK) {
+      res = RES_ERROR;
+    }
+  }
+  return res;
+}
+
+/**
+  * @brief  Get the number of sectors waiting for SD_Trim_Flush()
+  * @retval number of sectors
+  */
+uint32_t SD_Trim_Pending(void)
+{
+  uint32_t sectors = 0;
+  for (UINT i = 0; i < trim_count; i++) {
+    sectors += trim_ranges[i].end - trim_ranges[i].start + 1;
+  }
+  return sectors;
+}
+
+/**
+  * @brief  Get the TRIM statistics
+  * @param  stats: statistics
+  */
+void SD_Trim_GetStats(SD_TrimStats *stats)
+{
+  *stats = trim_stats;
+}
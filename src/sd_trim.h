@@ -0,0 +1,89 @@
+/**
+  ******************************************************************************
+  * @file    sd_trim.h
+  * @brief   This file contains the definitions and functions prototypes of
+  *          the TRIM support of the SD block layer.
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SD_TRIM_H
+#define __SD_TRIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "FatFs.h"
+
+/* TRIM policies */
+#define SD_TRIM_DISABLED         0  /* Freed sectors are not erased            */
+#define SD_TRIM_IMMEDIATE        1  /* Freed sectors are erased at once        */
+#define SD_TRIM_DEFERRED         2  /* Freed sectors are erased by SD_Trim_Flush() */
+
+/* Could be redefined in variant.h or using build_opt.h */
+#ifndef SD_TRIM_POLICY
+#define SD_TRIM_POLICY           SD_TRIM_DEFERRED
+#endif
+
+/* Maximum number of ranges waiting for SD_Trim_Flush(), the smallest range
+   is dropped when full */
+#ifndef SD_TRIM_RANGES
+#define SD_TRIM_RANGES           8
+#endif
+
+/* Maximum time in ms for the card to complete an erase command */
+#ifndef SD_TRIM_ERASE_TIMEOUT
+#define SD_TRIM_ERASE_TIMEOUT    63000U
+#endif
+
+/* TRIM statistics */
+typedef struct {
+  uint32_t Requests;    /*!< Ranges freed by FatFs (CTRL_TRIM)              */
+  uint32_t Commands;    /*!< Erase commands issued                          */
+  uint32_t Trimmed;     /*!< Sectors erased                                 */
+  uint32_t Dropped;     /*!< Sectors of deferred ranges dropped (full)      */
+  uint32_t Cancelled;   /*!< Sectors of deferred ranges written again       */
+  uint32_t Errors;      /*!< Erase commands failed                          */
+} SD_TrimStats;
+
+void    SD_Trim_Init(void);
+void    SD_Trim_SetPolicy(uint8_t policy);
+uint8_t SD_Trim_GetPolicy(void);
+DRESULT SD_Trim_Range(BYTE lun, DWORD start, DWORD end);
+void    SD_Trim_Cancel(DWORD sector, UINT count);
+DRESULT SD_Trim_Flush(BYTE lun);
+uint32_t SD_Trim_Pending(void);
+void    SD_Trim_GetStats(SD_TrimStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SD_TRIM_H */
@@ -0,0 +1,265 @@
+/**
+******************************************************************************
+* @file    sd_wqueue.c
+* @brief   This file includes the write queue of the SD block layer. Small
+*          writes are queued and written on flush by runs of contiguous
+*          sectors, one multi-block write per run. Data sectors are written
+*          first, then the metadata sectors (FAT and FAT12/16 root
+*          directory, before the data area) so that they never reference
+*          data not yet on the card.
+******************************************************************************
+* @attention
+*
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*   1. Redistributions of source code must retain the above copyright notice,
+*      this list of conditions and the following disclaimer.
+*   2. Redistributions in binary form must reproduce the above copyright notice,
+*      this list of conditions and the following disclaimer in the documentation
+*      and/or other materials provided with the distribution.
+*   3. Neither the name of STMicroelectronics nor the names of its contributors
+*      may be used to endorse or promote products derived from this software
+*      without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+******************************************************************************
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "sd_wqueue.h"
+#include "sd_block.h"
+#include <string.h>
+
+#if SD_WQUEUE_SECTORS > 0
+
+/* Write Queue Private Variables */
+static DWORD wq_sector[SD_WQUEUE_SECTORS];
+/* Word aligned to allow DMA transfers, one more sector used to sort */
+static uint32_t wq_data[SD_WQUEUE_SECTORS + 1][SD_BLOCK_SIZE / 4];
+static UINT wq_count;
+static DWORD wq_data_start;
+static SD_WQueueStats wq_stats;
+
+/**
+  * @brief  Index of a queued sector.
+  * @retval index or -1 if not queued
+  */
+static int wq_lookup(DWORD sector)
+{
+  for (UINT i = 0; i < wq_count; i++) {
+    if (wq_sector[i] == sector) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+/**
+  * @brief  Flush order: data sectors, then metadata ones, each ascending.
+  * @retval non 0 if sector a is written before sector b
+  */
+static int wq_before(DWORD a, DWORD b)
+{
+  int meta_a = (a < wq_data_start);
+  int meta_b = (b < wq_data_start);
+  if (meta_a != meta_b) {
+    return meta_b;
+  }
+  return (a < b);
+}
+
+/**
+  * @brief  Sort the queue, data included, in flush order (insertion sort,
+  *         the queue being short and mostly in order already).
+  */
+static void wq_sort(void)
+{
+  for (UINT i = 1; i < wq_count; i++) {
+    DWORD sector = wq_sector[i];
+    UINT j = i;
+    if (!wq_before(sector, wq_sector[j - 1])) {
+      continue;
+    }
+    memcpy(wq_data[SD_WQUEUE_SECTORS], wq_data[i], SD_BLOCK_SIZE);
+    while ((j > 0) && wq_before(sector, wq_sector[j - 1])) {
+      wq_sector[j] = wq_sector[j - 1];
+      memcpy(wq_data[j], wq_data[j - 1], SD_BLOCK_SIZE);
+      j--;
+    }
+    wq_sector[j] = sector;
+    memcpy(wq_data[j], wq_data[SD_WQUEUE_SECTORS], SD_BLOCK_SIZE);
+  }
+}
+
+/**
+  * @brief  Initializes the write queue, queued sectors are lost
+  */
+void SD_WQueue_Init(void)
+{
+  wq_count = 0;
+  memset(&wq_stats, 0, sizeof(wq_stats));
+}
+
+/**
+  * @brief  Set the first sector of the data area, sectors before it are
+  *         written last
+  * @param  sector: first data sector
+  */
+void SD_WQueue_SetDataStart(DWORD sector)
+{
+  wq_data_start = sector;
+}
+
+/**
+  * @brief  Writes Sector(s) to the queue. Writes of SD_WQUEUE_BYPASS
+  *         sectors or more go to the card at once.
+  * @param  lun : not used
+  * @param  *buff: Data to be written
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors to write
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_WQueue_Write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+  DRESULT res = RES_OK;
+
+  if (count >= SD_WQUEUE_BYPASS) {
+    /* Queued copies are outdated */
+    UINT i = 0;
+    while (i < wq_count) {
+      if ((wq_sector[i] >= sector) && (wq_sector[i] < sector + count)) {
+        wq_count--;
+        wq_sector[i] = wq_sector[wq_count];
+        memcpy(wq_data[i], wq_data[wq_count], SD_BLOCK_SIZE);
+        wq_stats.Overwritten++;
+      } else {
+        i++;
+      }
+    }
+    wq_stats.Bypass += count;
+    return SD_Block_CardWrite(lun, buff, sector, count);
+  }
+
+  for (UINT n = 0; (n < count) && (res == RES_OK); n++) {
+    int idx = wq_lookup(sector + n);
+    if (idx >= 0) {
+      wq_stats.Overwritten++;
+    } else {
+      if (wq_count == SD_WQUEUE_SECTORS) {
+        res = SD_WQueue_Flush(lun);
+        if (res != RES_OK) {
+          break;
+        }
+      }
+      idx = (int)wq_count++;
+      wq_sector[idx] = sector + n;
+    }
+    memcpy(wq_data[idx], &buff[n * SD_BLOCK_SIZE], SD_BLOCK_SIZE);
+    wq_stats.Queued++;
+  }
+  return res;
+}
+
+/**
+  * @brief  Replace the sectors read from the card by their queued version
+  * @param  *buff: Data read
+  * @param  sector: Sector address (LBA)
+  * @param  count: Number of sectors read
+  */
+void SD_WQueue_Overlay(BYTE *buff, DWORD sector, UINT count)
+{
+  for (UINT i = 0; i < wq_count; i++) {
+    if ((wq_sector[i] >= sector) && (wq_sector[i] < sector + count)) {
+      memcpy(&buff[(wq_sector[i] - sector) * SD_BLOCK_SIZE], wq_data[i], SD_BLOCK_SIZE);
+    }
+  }
+}
+
+/**
+  * @brief  Write all queued sectors, runs of contiguous sectors in one command
+  * @param  lun : not used
+  * @retval DRESULT: Operation result
+  */
+DRESULT SD_WQueue_Flush(BYTE lun)
+{
+  UINT start = 0;
+
+  if (wq_count == 0) {
+    return RES_OK;
+  }
+  wq_stats.Flushes++;
+  wq_sort();
+  while (start < wq_count) {
+    UINT end = start + 1;
+    while ((end < wq_count) && (wq_sector[end] == wq_sector[end - 1] + 1)) {
+      end++;
+    }
+    if (SD_Block_CardWrite(lun, (const BYTE *)wq_data[start], wq_sector[start], end - start) != RES_OK) {
+      /* Keep the sectors not written */
+      wq_count -= start;
+      memmove(wq_sector, &wq_sector[start], wq_count * sizeof(DWORD));
+      memmove(wq_data, wq_data[start], wq_count * SD_BLOCK_SIZE);
+      return RES_ERROR;
+    }
+    wq_stats.Commands++;
+    wq_stats.Sectors += end - start;
+    start = end;
+  }
+  wq_count = 0;
+  return RES_OK;
+}
+
+/**
+  * @brief  Get the write queue statistics
+  * @param  stats: statistics
+  */
+void SD_WQueue_GetStats(SD_WQueueStats *stats)
+{
+  *stats = wq_stats;
+}
+
+#else /* SD_WQUEUE_SECTORS == 0 */
+
+void SD_WQueue_Init(void)
+{
+}
+
+DRESULT SD_WQueue_Write(BYTE lun, const BYTE *buff, DWORD sector, UINT count)
+{
+  return SD_Block_CardWrite(lun, buff, sector, count);
+}
+
+void SD_WQueue_Overlay(BYTE *buff, DWORD sector, UINT count)
+{
+  UNUSED(buff);
+  UNUSED(sector);
+  UNUSED(count);
+}
+
+DRESULT SD_WQueue_Flush(BYTE lun)
+{
+  UNUSED(lun);
+  return RES_OK;
+}
+
+void SD_WQueue_SetDataStart(DWORD sector)
+{
+  UNUSED(sector);
+}
+
+void SD_WQueue_GetStats(SD_WQueueStats *stats)
+{
+  memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* SD_WQUEUE_SECTORS > 0 */
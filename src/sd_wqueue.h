@@ -0,0 +1,77 @@
+/**
+  ******************************************************************************
+  * @file    sd_wqueue.h
+  * @brief   This file contains the definitions and functions prototypes of
+  *          the write queue of the SD block layer.
+ ******************************************************************************
+  * @attention
+  *
+  * Redistribution and use in source and binary forms, with or without modification,
+  * are permitted provided that the following conditions are met:
+  *   1. Redistributions of source code must retain the above copyright notice,
+  *      this list of conditions and the following disclaimer.
+  *   2. Redistributions in binary form must reproduce the above copyright notice,
+  *      this list of conditions and the following disclaimer in the documentation
+  *      and/or other materials provided with the distribution.
+  *   3. Neither the name of STMicroelectronics nor the names of its contributors
+  *      may be used to endorse or promote products derived from this software
+  *      without specific prior written permission.
+  *
+  * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+  * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+  * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+  * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+  * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SD_WQUEUE_H
+#define __SD_WQUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "FatFs.h"
+
+/* Could be redefined in variant.h or using build_opt.h */
+/* Number of sectors the write queue can hold. 0 disables the write queue */
+#ifndef SD_WQUEUE_SECTORS
+#define SD_WQUEUE_SECTORS        0
+#endif
+
+/* Writes of at least this number of sectors are not queued */
+#ifndef SD_WQUEUE_BYPASS
+#define SD_WQUEUE_BYPASS         4
+#endif
+
+/* Write queue statistics */
+typedef struct {
+  uint32_t Queued;      /*!< Sectors queued                                 */
+  uint32_t Overwritten; /*!< Queued sectors replaced before being written   */
+  uint32_t Bypass;      /*!< Sectors written without being queued           */
+  uint32_t Commands;    /*!< Write commands issued by the queue flushes     */
+  uint32_t Sectors;     /*!< Sectors written by the queue flushes           */
+  uint32_t Flushes;     /*!< Queue flushes                                  */
+} SD_WQueueStats;
+
+void    SD_WQueue_Init(void);
+DRESULT SD_WQueue_Write(BYTE lun, const BYTE *buff, DWORD sector, UINT count);
+void    SD_WQueue_Overlay(BYTE *buff, DWORD sector, UINT count);
+DRESULT SD_WQueue_Flush(BYTE lun);
+void    SD_WQueue_SetDataStart(DWORD sector);
+void    SD_WQueue_GetStats(SD_WQueueStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SD_WQUEUE_H */